@@ -0,0 +1,197 @@
+#include "uart.h"
+#include "debug.h"
+#include "crash.h"
+
+/* offset in front of the data of stack and stats frames */
+#define CRASH_OFFSET 2
+
+/* r2 to r17, r28 and r29 */
+#define CRASH_SAVED 18
+
+/* end of static data and top of RAM, from the linker */
+extern unsigned char _end;
+extern unsigned char __stack;
+
+/* call-saved registers of the caller, stored by CRASH_Dump() on entry */
+static unsigned char CRASH_Regs[CRASH_SAVED];
+
+
+#ifndef CRASH_NO_PAINT
+/*************************************************************************
+Function: CRASH_Paint()
+Purpose:  fill the RAM between static data and stack with CRASH_PAINT,
+          runs from .init1 before the C runtime is set up, hence asm
+**************************************************************************/
+void CRASH_Paint(void) __attribute__((naked, used, section(".init1")));
+
+void CRASH_Paint(void)
+{
+    __asm__ __volatile__ (
+        "    ldi r30, lo8(_end)     \n"
+        "    ldi r31, hi8(_end)     \n"
+        "    ldi r24, %0            \n"
+        "    ldi r25, hi8(__stack)  \n"
+        "    rjmp 2f                \n"
+        "1:  st Z+, r24             \n"
+        "2:  cpi r30, lo8(__stack)  \n"
+        "    cpc r31, r25           \n"
+        "    brlo 1b                \n"
+        "    breq 1b                \n"
+        :: "M" (CRASH_PAINT) );
+}
+#endif
+
+
+/*************************************************************************
+Function: CRASH_Send()
+Purpose:  send a frame, with interrupts off the transmit ringbuffer only
+          empties by polling, so make room for all of it first
+**************************************************************************/
+static void CRASH_Send(unsigned char type, const unsigned char *payload, unsigned char len)
+{
+    UART_TxFlushPolled();
+    DEBUG_Send(type, payload, len);
+}
+
+
+/*************************************************************************
+Function: CRASH_SendBlock()
+Purpose:  send memory as a series of frames with their offset
+**************************************************************************/
+static void CRASH_SendBlock(unsigned char type, const unsigned char *p, unsigned int len)
+{
+    unsigned char frame[DEBUG_MAX_PAYLOAD];
+    unsigned int  offset = 0;
+    unsigned char n;
+    unsigned char i;
+
+
+    while ( offset < len ) {
+        n = DEBUG_MAX_PAYLOAD - CRASH_OFFSET;
+        if ( len - offset < n )
+            n = len - offset;
+        frame[0] = (unsigned char)offset;
+        frame[1] = (unsigned char)(offset >> 8);
+        for ( i = 0; i < n; i++ )
+            frame[CRASH_OFFSET + i] = p[offset + i];
+        CRASH_Send(type, frame, CRASH_OFFSET + n);
+        offset += n;
+    }
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: CRASH_StackHeadroom()
+Purpose:  find the lowest point the stack ever reached
+Input:    none
+Returns:  number of untouched bytes above the static data
+**************************************************************************/
+unsigned int CRASH_StackHeadroom(void)
+{
+#ifdef CRASH_NO_PAINT
+    return 0xFFFF;
+#else
+    const unsigned char *p = &_end;
+
+
+    while ( p <= &__stack && *p == CRASH_PAINT )
+        p++;
+    return p - &_end;
+#endif
+
+}/* CRASH_StackHeadroom */
+
+
+/*************************************************************************
+Function: CRASH_Report()
+Purpose:  flush pending output and send a crash dump by polling the UART,
+          entered from CRASH_Dump() by a jump, so it returns to its caller
+Input:    reason code and the stack pointer CRASH_Dump() was entered with
+**************************************************************************/
+static void __attribute__((noinline, used))
+CRASH_Report(unsigned char reason, unsigned int sp)
+{
+    unsigned char info[8];
+    unsigned char sreg;
+    unsigned int  pc;
+    unsigned int  len;
+#ifdef UART_STATS
+    UART_Stats    stats;
+#endif
+
+
+    sreg = SREG;
+    cli();
+    pc = (unsigned int)__builtin_return_address(0);
+
+    /* with interrupts off everything below goes out by polling UDR */
+    UART_TxFlushPolled();
+
+    len = CRASH_StackHeadroom();
+    info[0] = reason;
+    info[1] = sreg;
+    info[2] = (unsigned char)sp;
+    info[3] = (unsigned char)(sp >> 8);
+    info[4] = (unsigned char)pc;
+    info[5] = (unsigned char)(pc >> 8);
+    info[6] = (unsigned char)len;
+    info[7] = (unsigned char)(len >> 8);
+    CRASH_Send(CRASH_INFO, info, sizeof(info));
+    CRASH_Send(CRASH_REGS, CRASH_Regs, CRASH_SAVED);
+
+    len = &__stack - (unsigned char *)sp;
+    if ( len > CRASH_STACK_BYTES )
+        len = CRASH_STACK_BYTES;
+    CRASH_SendBlock(CRASH_STACK, (const unsigned char *)sp + 1, len);
+
+#ifdef UART_STATS
+    UART_GetStats(&stats, 0);
+    CRASH_SendBlock(CRASH_STATS, (const unsigned char *)&stats, sizeof(stats));
+#endif
+
+    UART_TxWait(0);
+}
+
+
+/*************************************************************************
+Function: CRASH_Dump()
+Purpose:  save the call-saved registers and the stack pointer before
+          compiled code can change them and go on in CRASH_Report(), hence
+          naked and asm
+Input:    application defined reason code, left in r24 for CRASH_Report(),
+          SP goes to r22:r23 as its second argument
+Returns:  none, with interrupts disabled
+**************************************************************************/
+void __attribute__((naked, noinline)) CRASH_Dump(unsigned char reason)
+{
+    __asm__ __volatile__ (
+        "    ldi r30, lo8(%0)   \n"
+        "    ldi r31, hi8(%0)   \n"
+        "    st Z+, r2          \n"
+        "    st Z+, r3          \n"
+        "    st Z+, r4          \n"
+        "    st Z+, r5          \n"
+        "    st Z+, r6          \n"
+        "    st Z+, r7          \n"
+        "    st Z+, r8          \n"
+        "    st Z+, r9          \n"
+        "    st Z+, r10         \n"
+        "    st Z+, r11         \n"
+        "    st Z+, r12         \n"
+        "    st Z+, r13         \n"
+        "    st Z+, r14         \n"
+        "    st Z+, r15         \n"
+        "    st Z+, r16         \n"
+        "    st Z+, r17         \n"
+        "    st Z+, r28         \n"
+        "    st Z+, r29         \n"
+        "    in r22, __SP_L__   \n"
+        "    in r23, __SP_H__   \n"
+        "    %~jmp %x1          \n"
+        :: "i" (CRASH_Regs), "i" (CRASH_Report) );
+
+}/* CRASH_Dump */
@@ -0,0 +1,87 @@
+#ifndef CRASH_H
+#define CRASH_H
+/************************************************************************
+Title:    Crash dump over the UART with interrupts disabled
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup CRASH Crash dump
+ *  @code #include <crash.h> @endcode
+ *
+ *  @brief Gets the last words of a dying firmware to the host.
+ *
+ *  CRASH_Dump() disables interrupts, sends whatever is still waiting in
+ *  the UART transmit buffer by polling UDR and then sends a dump as frames
+ *  on the debug channel (see debug.h), so it works from fatal error
+ *  handlers and from the watchdog interrupt that precedes a watchdog
+ *  reset, where the UDRE interrupt can't run anymore:
+ *
+ *  CRASH_INFO   reason, SREG, SP low, SP high, PC low, PC high,
+ *               stack headroom low, stack headroom high
+ *  CRASH_REGS   r2, r3, ... r17, r28, r29
+ *  CRASH_STACK  offset low, offset high, stack bytes from SP+1 upwards
+ *  CRASH_STATS  offset low, offset high, bytes of UART_Stats
+ *               (only with UART_STATS)
+ *
+ *  PC is the word address CRASH_Dump() was called from, double it to look
+ *  it up in the ELF. CRASH_REGS holds the call-saved registers as the
+ *  caller left them, stored before CRASH_Dump() touches any of them;
+ *  r28:r29 is the caller's frame pointer if it has one. The call-used
+ *  registers are not sent, the call has overwritten them already. SP is
+ *  taken at the same point, so the stack window starts with the return
+ *  address into the caller (high byte first) followed by the caller's
+ *  frame. The stack headroom is the smallest number of bytes that were
+ *  ever free between the end of the static data and the stack,
+ *  for that the RAM is painted with CRASH_PAINT at startup (not done if
+ *  CRASH_NO_PAINT is defined, the headroom reads 0xFFFF then).
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Number of stack bytes included in the dump */
+#ifndef CRASH_STACK_BYTES
+#define CRASH_STACK_BYTES 64
+#endif
+
+#define CRASH_PAINT     0xC5
+
+/*
+** debug channel frame types
+*/
+#define CRASH_INFO      'X'
+#define CRASH_REGS      'G'
+#define CRASH_STACK     'K'
+#define CRASH_STATS     'T'
+
+/*
+** function prototypes
+*/
+
+/**
+ *  @brief   Send a crash dump synchronously
+ *
+ *  Returns with interrupts disabled, the caller decides whether to halt,
+ *  reset or wait for the watchdog.
+ *
+ *  @param   reason application defined code sent with the dump
+ *  @return  none
+ */
+extern void CRASH_Dump(unsigned char reason);
+
+/**
+ *  @brief   Return the smallest stack headroom seen since reset
+ *  @param   none
+ *  @return  bytes never touched by the stack, 0xFFFF without painting
+ */
+extern unsigned int CRASH_StackHeadroom(void);
+
+/**@}*/
+
+#endif // CRASH_H
@@ -0,0 +1,209 @@
+#include "uart.h"
+#include "debug.h"
+
+/*
+ *  receiver states
+ */
+#define DEBUG_ST_IDLE   0
+#define DEBUG_ST_DLE    1
+#define DEBUG_ST_LEN    2
+#define DEBUG_ST_DATA   3
+#define DEBUG_ST_CHECK  4
+
+/* DLE, type, len and checksum */
+#define DEBUG_FRAME_OVERHEAD 4
+
+#if DEBUG_MAX_PAYLOAD + DEBUG_FRAME_OVERHEAD > UART_TX_BUFFER_MASK
+#error "UART_TX_BUFFER_SIZE too small for frames of DEBUG_MAX_PAYLOAD bytes"
+#endif
+
+/*
+ *  module global variables
+ */
+static unsigned char     DEBUG_Types[DEBUG_HANDLERS];
+static DEBUG_HandlerFunc DEBUG_Handlers[DEBUG_HANDLERS];
+static unsigned char     DEBUG_Buf[DEBUG_MAX_PAYLOAD];
+static unsigned char     DEBUG_State;
+static unsigned char     DEBUG_Type;
+static unsigned char     DEBUG_Len;
+static unsigned char     DEBUG_Count;
+static unsigned char     DEBUG_Check;
+
+
+/*************************************************************************
+Function: DEBUG_Dispatch()
+Purpose:  run the handler for a received frame
+**************************************************************************/
+static void DEBUG_Dispatch(void)
+{
+    unsigned char i;
+
+
+    for ( i = 0; i < DEBUG_HANDLERS; i++ ) {
+        if ( DEBUG_Handlers[i] && DEBUG_Types[i] == DEBUG_Type ) {
+            DEBUG_Handlers[i](DEBUG_Buf, DEBUG_Len);
+            return;
+        }
+    }
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: DEBUG_Register()
+Purpose:  set the handler for one frame type
+Input:    frame type and handler, NULL removes the handler
+Returns:  0 on success, 1 if no slot is free
+**************************************************************************/
+unsigned char DEBUG_Register(unsigned char type, DEBUG_HandlerFunc handler)
+{
+    unsigned char i;
+    unsigned char slot = DEBUG_HANDLERS;
+
+
+    for ( i = 0; i < DEBUG_HANDLERS; i++ ) {
+        if ( DEBUG_Handlers[i] && DEBUG_Types[i] == type ) {
+            slot = i;
+            break;
+        }
+        if ( !DEBUG_Handlers[i] && slot == DEBUG_HANDLERS )
+            slot = i;
+    }
+    if ( slot == DEBUG_HANDLERS )
+        return 1;
+
+    DEBUG_Types[slot]    = type;
+    DEBUG_Handlers[slot] = handler;
+    return 0;
+
+}/* DEBUG_Register */
+
+
+/*************************************************************************
+Function: DEBUG_Input()
+Purpose:  take debug frames out of the received data
+Input:    return value of UART_CharGetNonBlocking()
+Returns:  the character for the application, or UART_NO_DATA
+**************************************************************************/
+unsigned int DEBUG_Input(unsigned int c)
+{
+    unsigned char data = (unsigned char)c;
+
+
+    if ( c & UART_NO_DATA )
+        return c;
+
+    if ( DEBUG_State != DEBUG_ST_IDLE && (c & 0xFF00) ) {
+        /* damaged frame, drop it */
+        DEBUG_State = DEBUG_ST_IDLE;
+        return UART_NO_DATA;
+    }
+
+    switch ( DEBUG_State ) {
+    case DEBUG_ST_IDLE:
+        if ( data != DEBUG_DLE )
+            return c;
+        DEBUG_State = DEBUG_ST_DLE;
+        break;
+
+    case DEBUG_ST_DLE:
+        if ( data == DEBUG_DLE ) {
+            /* escaped application DLE */
+            DEBUG_State = DEBUG_ST_IDLE;
+            return c;
+        }
+        DEBUG_Type  = data;
+        DEBUG_Check = data;
+        DEBUG_State = DEBUG_ST_LEN;
+        break;
+
+    case DEBUG_ST_LEN:
+        if ( data > DEBUG_MAX_PAYLOAD ) {
+            DEBUG_State = DEBUG_ST_IDLE;
+            break;
+        }
+        DEBUG_Len    = data;
+        DEBUG_Count  = 0;
+        DEBUG_Check ^= data;
+        DEBUG_State  = data ? DEBUG_ST_DATA : DEBUG_ST_CHECK;
+        break;
+
+    case DEBUG_ST_DATA:
+        DEBUG_Buf[DEBUG_Count++] = data;
+        DEBUG_Check ^= data;
+        if ( DEBUG_Count == DEBUG_Len )
+            DEBUG_State = DEBUG_ST_CHECK;
+        break;
+
+    case DEBUG_ST_CHECK:
+        DEBUG_State = DEBUG_ST_IDLE;
+        if ( data == DEBUG_Check )
+            DEBUG_Dispatch();
+        break;
+    }
+    return UART_NO_DATA;
+
+}/* DEBUG_Input */
+
+
+/*************************************************************************
+Function: DEBUG_Send()
+Purpose:  queue a frame if the transmit buffer can take all of it
+Input:    frame type, payload and its length
+Returns:  1 if queued, 0 if there was no room
+**************************************************************************/
+unsigned char DEBUG_Send(unsigned char type, const unsigned char *payload, unsigned char len)
+{
+    unsigned char head[3];
+    unsigned char check;
+    unsigned char i;
+
+
+    if ( len > DEBUG_MAX_PAYLOAD || UART_TxFree() < (unsigned int)len + DEBUG_FRAME_OVERHEAD )
+        return 0;
+
+    check = type ^ len;
+    for ( i = 0; i < len; i++ )
+        check ^= payload[i];
+
+    head[0] = DEBUG_DLE;
+    head[1] = type;
+    head[2] = len;
+    UART_BlockPutNonBlocking(head, 3);
+    UART_BlockPutNonBlocking(payload, len);
+    UART_BlockPutNonBlocking(&check, 1);
+    return 1;
+
+}/* DEBUG_Send */
+
+
+/*************************************************************************
+Function: DEBUG_CharPut()
+Purpose:  send an application character, escaping DLE
+Input:    character
+Returns:  none
+**************************************************************************/
+void DEBUG_CharPut(unsigned char c)
+{
+    if ( c == DEBUG_DLE )
+        UART_CharPutNonBlocking(DEBUG_DLE);
+    UART_CharPutNonBlocking(c);
+
+}/* DEBUG_CharPut */
+
+
+/*************************************************************************
+Function: DEBUG_StringPut()
+Purpose:  send an application string, escaping DLE
+Input:    string
+Returns:  none
+**************************************************************************/
+void DEBUG_StringPut(const char *s)
+{
+    while ( *s )
+        DEBUG_CharPut(*s++);
+
+}/* DEBUG_StringPut */
@@ -0,0 +1,110 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+/************************************************************************
+Title:    Binary debug channel multiplexed with application traffic
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup DEBUG Debug channel
+ *  @code #include <debug.h> @endcode
+ *
+ *  @brief Carries binary frames for the debug tools over the same UART
+ *         as the application's own traffic.
+ *
+ *  A frame is introduced by DLE (0x10):
+ *      DLE, type, len, len payload bytes, checksum
+ *  where checksum is the XOR of type, len and the payload. A DLE that
+ *  belongs to the application is sent as DLE DLE in either direction:
+ *  DEBUG_Input() turns a received DLE DLE back into one DLE, on the
+ *  transmit side DEBUG_CharPut() and DEBUG_StringPut() double it. Output
+ *  queued with the UART_...Put functions goes out as it is and must not
+ *  contain DLE, or the host takes it for the start of a frame.
+ *
+ *  Feed every received character through DEBUG_Input(), it consumes
+ *  the frames, runs the handler registered for their type and passes
+ *  everything else on:
+ *  @code
+ *  c = DEBUG_Input(UART_CharGetNonBlocking());
+ *  if ( !(c & UART_NO_DATA) ) ...application byte...
+ *  @endcode
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Largest frame payload in both directions, sets the size of the
+    receive buffer; a whole frame must fit into the UART transmit buffer */
+#ifndef DEBUG_MAX_PAYLOAD
+#define DEBUG_MAX_PAYLOAD 24
+#endif
+
+/** Number of frame types handlers can be registered for */
+#ifndef DEBUG_HANDLERS
+#define DEBUG_HANDLERS 4
+#endif
+
+#define DEBUG_DLE 0x10
+
+#if DEBUG_MAX_PAYLOAD > 255
+#error "DEBUG_MAX_PAYLOAD must not exceed 255"
+#endif
+
+/** @brief  Handles a received frame, payload is valid during the call only */
+typedef void (*DEBUG_HandlerFunc)(const unsigned char *payload, unsigned char len);
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Set the handler for received frames of one type
+   @param   type    frame type
+   @param   handler called for every good frame of that type, NULL removes it
+   @return  0 on success, 1 if all DEBUG_HANDLERS slots are in use
+*/
+extern unsigned char DEBUG_Register(unsigned char type, DEBUG_HandlerFunc handler);
+
+/**
+ *  @brief   Filter a received character
+ *
+ *  Frames with a bad checksum, an oversized length or a receive error in
+ *  them are dropped silently, the host repeats its request.
+ *
+ *  @param   c return value of UART_CharGetNonBlocking()
+ *  @return  c, or UART_NO_DATA if the character belonged to a frame
+ */
+extern unsigned int DEBUG_Input(unsigned int c);
+
+/**
+   @brief   Send an application character, a DLE is sent twice
+   @param   c character, waits for room in the transmit buffer like
+              UART_CharPutNonBlocking()
+   @return  none
+*/
+extern void DEBUG_CharPut(unsigned char c);
+
+/**
+   @brief   Send an application string, every DLE in it is sent twice
+   @param   s string, waits for room like UART_StringPutNonBlocking()
+   @return  none
+*/
+extern void DEBUG_StringPut(const char *s);
+
+/**
+ *  @brief   Queue a frame for transmission without blocking
+ *  @param   type    frame type
+ *  @param   payload frame payload
+ *  @param   len     payload length, at most DEBUG_MAX_PAYLOAD
+ *  @return  1 if the frame was queued, 0 if the transmit buffer has no room
+ */
+extern unsigned char DEBUG_Send(unsigned char type, const unsigned char *payload, unsigned char len);
+
+/**@}*/
+
+#endif // DEBUG_H
@@ -0,0 +1,165 @@
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include "uart.h"
+#include "debug.h"
+#include "monitor.h"
+
+/* space and address in front of the data of every frame */
+#define MONITOR_HEADER 3
+
+/* EEPROM write request, carried out by MONITOR_Poll() */
+static unsigned char MONITOR_EeData[DEBUG_MAX_PAYLOAD - MONITOR_HEADER];
+static unsigned int  MONITOR_EeAddr;
+static unsigned char MONITOR_EeCount;      /* bytes requested, 0 if idle */
+static unsigned char MONITOR_EeDone;       /* bytes written so far        */
+
+
+/*************************************************************************
+Function: MONITOR_Read()
+Purpose:  debug channel handler, answer a memory read request
+**************************************************************************/
+static void MONITOR_Read(const unsigned char *payload, unsigned char len)
+{
+    unsigned char answer[DEBUG_MAX_PAYLOAD];
+    unsigned char count;
+    unsigned char i;
+    unsigned int  addr;
+
+
+    if ( len != MONITOR_HEADER + 1 )
+        return;
+    count = payload[3];
+    if ( count > DEBUG_MAX_PAYLOAD - MONITOR_HEADER )
+        return;
+    /* reading would wait for the EEPROM write under way */
+    if ( payload[0] == MONITOR_EEPROM && MONITOR_EeCount )
+        return;
+
+    addr = payload[1] | (payload[2] << 8);
+    for ( i = 0; i < count; i++, addr++ ) {
+        switch ( payload[0] ) {
+        case MONITOR_DATA:
+            answer[MONITOR_HEADER + i] = *(const volatile unsigned char *)addr;
+            break;
+        case MONITOR_FLASH:
+            answer[MONITOR_HEADER + i] = pgm_read_byte(addr);
+            break;
+        case MONITOR_EEPROM:
+            answer[MONITOR_HEADER + i] = eeprom_read_byte((const unsigned char *)addr);
+            break;
+        default:
+            return;
+        }
+    }
+
+    answer[0] = payload[0];
+    answer[1] = payload[1];
+    answer[2] = payload[2];
+    DEBUG_Send(MONITOR_READ, answer, MONITOR_HEADER + count);
+}
+
+
+/*************************************************************************
+Function: MONITOR_Write()
+Purpose:  debug channel handler, carry out a memory write request
+**************************************************************************/
+static void MONITOR_Write(const unsigned char *payload, unsigned char len)
+{
+    unsigned char answer[MONITOR_HEADER + 1];
+    unsigned char count;
+    unsigned char i;
+    unsigned int  addr;
+
+
+    if ( len < MONITOR_HEADER )
+        return;
+    count = len - MONITOR_HEADER;
+
+    addr = payload[1] | (payload[2] << 8);
+    switch ( payload[0] ) {
+    case MONITOR_DATA:
+        for ( i = 0; i < count; i++ )
+            ((volatile unsigned char *)addr)[i] = payload[MONITOR_HEADER + i];
+        break;
+    case MONITOR_EEPROM:
+        /* a byte takes 3.4 ms, MONITOR_Poll() writes them one at a time
+           and answers once the last one is done */
+        if ( MONITOR_EeCount )
+            return;
+        if ( count == 0 )
+            break;
+        for ( i = 0; i < count; i++ )
+            MONITOR_EeData[i] = payload[MONITOR_HEADER + i];
+        MONITOR_EeAddr  = addr;
+        MONITOR_EeDone  = 0;
+        MONITOR_EeCount = count;
+        return;
+    case MONITOR_FLASH:
+        count = 0;
+        break;
+    default:
+        return;
+    }
+
+    answer[0] = payload[0];
+    answer[1] = payload[1];
+    answer[2] = payload[2];
+    answer[3] = count;
+    DEBUG_Send(MONITOR_WRITE, answer, sizeof(answer));
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: MONITOR_Poll()
+Purpose:  go on with an EEPROM write request, one byte per call while the
+          EEPROM is ready, and answer it once all bytes are written
+Input:    none
+Returns:  none
+**************************************************************************/
+void MONITOR_Poll(void)
+{
+    unsigned char answer[MONITOR_HEADER + 1];
+
+
+    if ( MONITOR_EeCount == 0 || !eeprom_is_ready() )
+        return;
+
+    if ( MONITOR_EeDone < MONITOR_EeCount ) {
+        eeprom_update_byte((unsigned char *)MONITOR_EeAddr + MONITOR_EeDone,
+                           MONITOR_EeData[MONITOR_EeDone]);
+        MONITOR_EeDone++;
+        return;
+    }
+
+    answer[0] = MONITOR_EEPROM;
+    answer[1] = (unsigned char)MONITOR_EeAddr;
+    answer[2] = (unsigned char)(MONITOR_EeAddr >> 8);
+    answer[3] = MONITOR_EeCount;
+    /* without room for the answer try again with the next call */
+    if ( DEBUG_Send(MONITOR_WRITE, answer, sizeof(answer)) )
+        MONITOR_EeCount = 0;
+
+}/* MONITOR_Poll */
+
+
+/*************************************************************************
+Function: MONITOR_Init()
+Purpose:  register the request handlers with the debug channel
+Input:    none
+Returns:  0 on success, 1 if no handler slots are free
+**************************************************************************/
+unsigned char MONITOR_Init(void)
+{
+    if ( DEBUG_Register(MONITOR_READ, MONITOR_Read) )
+        return 1;
+    if ( DEBUG_Register(MONITOR_WRITE, MONITOR_Write) ) {
+        DEBUG_Register(MONITOR_READ, 0);
+        return 1;
+    }
+    return 0;
+
+}/* MONITOR_Init */
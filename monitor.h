@@ -0,0 +1,73 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+/************************************************************************
+Title:    Memory peek/poke monitor on the debug channel
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup MONITOR Monitor
+ *  @code #include <monitor.h> @endcode
+ *
+ *  @brief Serves memory read and write requests from the host while the
+ *         application keeps running.
+ *
+ *  Requests and answers are frames on the debug channel (see debug.h), so
+ *  they are handled from the main loop inside DEBUG_Input() and never
+ *  stop the CPU. The cost of one request is bounded by DEBUG_MAX_PAYLOAD.
+ *  EEPROM writes are carried out by MONITOR_Poll(), which the main loop
+ *  has to call as well.
+ *
+ *  MONITOR_READ  request: space, address low, address high, count
+ *                answer:  space, address low, address high, data
+ *  MONITOR_WRITE request: space, address low, address high, data
+ *                answer:  space, address low, address high, bytes written
+ *
+ *  The data space covers RAM and the I/O registers, which are memory
+ *  mapped on the AVR. Flash can only be read, a write answers 0 bytes.
+ *  EEPROM writes take about 3.4 ms per changed byte, MONITOR_Poll() starts
+ *  one byte per call once the EEPROM is ready and answers after the last
+ *  one is done; until then EEPROM reads and writes are not answered. A
+ *  request that is malformed, or whose answer does not fit into the
+ *  transmit buffer, is not answered and has to be repeated by the host.
+ */
+
+/**@{*/
+
+/*
+** debug channel frame types
+*/
+#define MONITOR_READ    'R'
+#define MONITOR_WRITE   'W'
+
+/*
+** address spaces
+*/
+#define MONITOR_DATA    0       /* RAM and I/O registers                   */
+#define MONITOR_FLASH   1       /* program memory, first 64 KB, read only  */
+#define MONITOR_EEPROM  2
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Register the request handlers with the debug channel
+   @param   none
+   @return  0 on success, 1 if the debug channel has no free handler slots
+*/
+extern unsigned char MONITOR_Init(void);
+
+/**
+   @brief   Carry out a pending EEPROM write request, call it from the
+            main loop; returns right away while the EEPROM is busy
+   @param   none
+   @return  none
+*/
+extern void MONITOR_Poll(void);
+
+/**@}*/
+
+#endif // MONITOR_H
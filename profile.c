@@ -0,0 +1,87 @@
+#include "uart.h"
+#include "debug.h"
+#include "profile.h"
+
+/* frame payload: lost count and the samples */
+#define PROFILE_FRAME_SIZE  ( 2 * PROFILE_FRAME_SAMPLES + 1 )
+
+#if PROFILE_FRAME_SIZE > DEBUG_MAX_PAYLOAD
+#error "PROFILE_FRAME_SAMPLES too large for DEBUG_MAX_PAYLOAD"
+#endif
+
+/*
+ *  module global variables
+ */
+static volatile unsigned int  PROFILE_Buf[PROFILE_BUFFER_SIZE];
+static volatile unsigned char PROFILE_Head;
+static volatile unsigned char PROFILE_Tail;
+static volatile unsigned char PROFILE_Lost;
+
+
+/*************************************************************************
+Function: PROFILE_Record()
+Purpose:  store a sample in the sample buffer, drop it if full
+Input:    word address of the interrupted code
+Returns:  none
+**************************************************************************/
+void PROFILE_Record(unsigned int pc)
+{
+    unsigned char tmphead;
+
+
+    tmphead = (PROFILE_Head + 1) & PROFILE_BUFFER_MASK;
+    if ( tmphead == PROFILE_Tail ) {
+        if ( PROFILE_Lost != 0xFF )
+            PROFILE_Lost++;
+        return;
+    }
+    PROFILE_Buf[tmphead] = pc;
+    PROFILE_Head = tmphead;
+
+}/* PROFILE_Record */
+
+
+/*************************************************************************
+Function: PROFILE_Flush()
+Purpose:  queue a frame of samples if there is room for it
+Input:    none
+Returns:  1 if a frame was queued, 0 otherwise
+**************************************************************************/
+unsigned char PROFILE_Flush(void)
+{
+    unsigned char frame[PROFILE_FRAME_SIZE];
+    unsigned char tmptail;
+    unsigned char sreg;
+    unsigned char i;
+    unsigned int  pc;
+
+
+    if ( ((PROFILE_Head - PROFILE_Tail) & PROFILE_BUFFER_MASK) < PROFILE_FRAME_SAMPLES )
+        return 0;
+
+    tmptail = PROFILE_Tail;
+    for ( i = 1; i < PROFILE_FRAME_SIZE; i += 2 ) {
+        tmptail = (tmptail + 1) & PROFILE_BUFFER_MASK;
+        pc = PROFILE_Buf[tmptail];
+        frame[i]     = (unsigned char)pc;
+        frame[i + 1] = (unsigned char)(pc >> 8);
+    }
+
+    sreg = SREG;
+    cli();
+    frame[0] = PROFILE_Lost;
+    PROFILE_Lost = 0;
+    SREG = sreg;
+
+    if ( !DEBUG_Send(PROFILE_SAMPLES, frame, PROFILE_FRAME_SIZE) ) {
+        /* not sent, report the losses with the next frame */
+        sreg = SREG;
+        cli();
+        PROFILE_Lost = ( PROFILE_Lost > 0xFF - frame[0] ) ? 0xFF : PROFILE_Lost + frame[0];
+        SREG = sreg;
+        return 0;
+    }
+    PROFILE_Tail = tmptail;
+    return 1;
+
+}/* PROFILE_Flush */
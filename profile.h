@@ -0,0 +1,91 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+/************************************************************************
+Title:    Statistical PC sampling profiler streamed over the UART
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h, plus a timer for the sample rate
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup PROFILE Profiler
+ *  @code #include <profile.h> @endcode
+ *
+ *  @brief Samples the program counter from a timer interrupt and sends
+ *         the samples to the host in small binary frames.
+ *
+ *  Put PROFILE_ISR() with the vector of a periodic timer interrupt in one
+ *  source file, and call PROFILE_Flush() from the main loop. The samples
+ *  are only queued when the UART transmit buffer has room, so the profiler
+ *  never blocks the application. Its bandwidth is bounded by the sample
+ *  rate: 2 bytes per sample plus 5 bytes per frame, e.g. 1 kHz sampling
+ *  with 8 samples per frame takes 2625 of the 11520 bytes/s at 115200 Bd.
+ *
+ *  The samples travel as PROFILE_SAMPLES frames on the debug channel (see
+ *  debug.h), payload:
+ *      lost, then PROFILE_FRAME_SAMPLES samples low byte first
+ *  lost counts samples dropped since the previous frame, saturating at 255.
+ *  A sample is the word address of the interrupted instruction as given
+ *  by avr-gcc's __builtin_return_address(0), the host doubles it and looks
+ *  it up in the ELF, e.g. with addr2line, to get function and line.
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Size of the sample buffer, must be power of 2 */
+#ifndef PROFILE_BUFFER_SIZE
+#define PROFILE_BUFFER_SIZE 16
+#endif
+
+/** Samples sent per frame, at most PROFILE_BUFFER_SIZE-1 */
+#ifndef PROFILE_FRAME_SAMPLES
+#define PROFILE_FRAME_SAMPLES 8
+#endif
+
+#define PROFILE_BUFFER_MASK ( PROFILE_BUFFER_SIZE - 1)
+
+#if PROFILE_BUFFER_SIZE < 2 || PROFILE_BUFFER_SIZE > 256 || (PROFILE_BUFFER_SIZE & PROFILE_BUFFER_MASK)
+#error "PROFILE_BUFFER_SIZE must be a power of 2 from 2 to 256"
+#endif
+#if PROFILE_FRAME_SAMPLES >= PROFILE_BUFFER_SIZE
+#error "PROFILE_FRAME_SAMPLES must be smaller than PROFILE_BUFFER_SIZE"
+#endif
+
+/* debug channel frame type */
+#define PROFILE_SAMPLES 'P'
+
+/** @brief  Define the sampling timer interrupt
+ *  @param  vector timer interrupt vector, e.g. TIMER0_COMP_vect
+ */
+#define PROFILE_ISR(vector) \
+    ISR(vector) { PROFILE_Record((unsigned int)__builtin_return_address(0)); }
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Store one sample, called by the interrupt defined with PROFILE_ISR()
+   @param   pc word address of the interrupted code
+   @return  none
+*/
+extern void PROFILE_Record(unsigned int pc);
+
+/**
+ *  @brief   Queue a frame of samples for transmission
+ *
+ *  Sends one frame if PROFILE_FRAME_SAMPLES samples are waiting and the
+ *  UART transmit buffer can take the whole frame without blocking.
+ *
+ *  @param   none
+ *  @return  1 if a frame was queued, 0 otherwise
+ */
+extern unsigned char PROFILE_Flush(void);
+
+/**@}*/
+
+#endif // PROFILE_H
@@ -0,0 +1,128 @@
+#include "uart.h"
+#include "debug.h"
+#include "scope.h"
+
+/*
+ *  module global variables
+ */
+static const volatile unsigned char *SCOPE_Addr[SCOPE_CHANNELS];
+static unsigned char          SCOPE_Size[SCOPE_CHANNELS];
+static volatile unsigned char SCOPE_Count;          /* channels, 0 = off  */
+static unsigned char          SCOPE_Bytes;          /* payload per sample */
+static unsigned char          SCOPE_Seq;
+static unsigned char          SCOPE_Buf[SCOPE_BUFFERS][DEBUG_MAX_PAYLOAD];
+static volatile unsigned char SCOPE_Head;
+static volatile unsigned char SCOPE_Tail;
+
+
+/*************************************************************************
+Function: SCOPE_Config()
+Purpose:  debug channel handler, take the channel list from the host
+**************************************************************************/
+static void SCOPE_Config(const unsigned char *payload, unsigned char len)
+{
+    unsigned char n = 0;
+    unsigned char bytes = 1;    /* sequence number */
+    unsigned char size;
+
+
+    /* stop sampling while the list changes and drop old samples */
+    SCOPE_Count = 0;
+    SCOPE_Tail  = SCOPE_Head;
+
+    while ( len >= 3 && n < SCOPE_CHANNELS ) {
+        size = payload[2];
+        if ( size == 0 || size > DEBUG_MAX_PAYLOAD - bytes )
+            break;
+        SCOPE_Addr[n] = (const volatile unsigned char *)(payload[0] | (payload[1] << 8));
+        SCOPE_Size[n] = size;
+        bytes += size;
+        payload += 3;
+        len -= 3;
+        n++;
+    }
+
+    SCOPE_Bytes = bytes;
+    SCOPE_Count = n;
+    DEBUG_Send(SCOPE_CONFIG, &n, 1);
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: SCOPE_Init()
+Purpose:  register the configuration handler with the debug channel
+Input:    none
+Returns:  0 on success, 1 if no handler slot is free
+**************************************************************************/
+unsigned char SCOPE_Init(void)
+{
+    SCOPE_Count = 0;
+    return DEBUG_Register(SCOPE_CONFIG, SCOPE_Config);
+
+}/* SCOPE_Init */
+
+
+/*************************************************************************
+Function: SCOPE_Tick()
+Purpose:  copy all channels into the sample buffer, from a timer interrupt
+Input:    none
+Returns:  none
+**************************************************************************/
+void SCOPE_Tick(void)
+{
+    const volatile unsigned char *addr;
+    unsigned char *p;
+    unsigned char tmphead;
+    unsigned char count;
+    unsigned char i;
+    unsigned char n;
+
+
+    count = SCOPE_Count;
+    if ( !count )
+        return;
+
+    tmphead = (SCOPE_Head + 1) & SCOPE_BUFFER_MASK;
+    if ( tmphead == SCOPE_Tail ) {
+        /* no room, the host sees the gap in the sequence numbers */
+        SCOPE_Seq++;
+        return;
+    }
+
+    p = SCOPE_Buf[tmphead];
+    *p++ = SCOPE_Seq++;
+    for ( i = 0; i < count; i++ ) {
+        addr = SCOPE_Addr[i];
+        for ( n = SCOPE_Size[i]; n; n-- )
+            *p++ = *addr++;
+    }
+    SCOPE_Head = tmphead;
+
+}/* SCOPE_Tick */
+
+
+/*************************************************************************
+Function: SCOPE_Flush()
+Purpose:  send the oldest sample if the transmit buffer has room for it
+Input:    none
+Returns:  1 if a frame was queued, 0 otherwise
+**************************************************************************/
+unsigned char SCOPE_Flush(void)
+{
+    unsigned char tmptail;
+
+
+    if ( SCOPE_Head == SCOPE_Tail )
+        return 0;
+
+    tmptail = (SCOPE_Tail + 1) & SCOPE_BUFFER_MASK;
+    if ( !DEBUG_Send(SCOPE_SAMPLE, SCOPE_Buf[tmptail], SCOPE_Bytes) )
+        return 0;
+    SCOPE_Tail = tmptail;
+    return 1;
+
+}/* SCOPE_Flush */
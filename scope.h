@@ -0,0 +1,87 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+/************************************************************************
+Title:    Live variable streaming over the debug channel
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h, plus a timer for the sample rate
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup SCOPE Scope
+ *  @code #include <scope.h> @endcode
+ *
+ *  @brief Samples a list of RAM or I/O locations chosen by the host at a
+ *         fixed rate and streams them as binary frames.
+ *
+ *  The host selects the locations with a SCOPE_CONFIG frame on the debug
+ *  channel (see debug.h), payload: n times address low, address high,
+ *  size. The device answers with a SCOPE_CONFIG frame holding the number of
+ *  channels it accepted, an empty list stops sampling.
+ *
+ *  SCOPE_Tick(), called from a timer interrupt, copies the locations into a
+ *  sample buffer, so multi byte variables are never torn by the main loop.
+ *  SCOPE_Flush(), called from the main loop, moves complete samples into
+ *  the UART transmit buffer as SCOPE_SAMPLE frames:
+ *      sequence number, then the bytes of each channel in list order
+ *  A jump in the sequence number tells the host that samples were dropped
+ *  because the link could not keep up.
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Maximum number of sampled locations */
+#ifndef SCOPE_CHANNELS
+#define SCOPE_CHANNELS 8
+#endif
+
+/** Number of samples buffered between SCOPE_Tick() and SCOPE_Flush(), must be power of 2 */
+#ifndef SCOPE_BUFFERS
+#define SCOPE_BUFFERS 2
+#endif
+
+#define SCOPE_BUFFER_MASK ( SCOPE_BUFFERS - 1)
+
+#if SCOPE_BUFFERS < 2 || SCOPE_BUFFERS > 128 || (SCOPE_BUFFERS & SCOPE_BUFFER_MASK)
+#error "SCOPE_BUFFERS must be a power of 2 from 2 to 128"
+#endif
+
+/*
+** debug channel frame types
+*/
+#define SCOPE_CONFIG   'S'      /* channel list, and its acknowledge       */
+#define SCOPE_SAMPLE   'V'      /* one sample of all channels              */
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Register the configuration handler with the debug channel
+   @param   none
+   @return  0 on success, 1 if the debug channel has no free handler slot
+*/
+extern unsigned char SCOPE_Init(void);
+
+/**
+   @brief   Take a sample, call from a periodic timer interrupt
+   @param   none
+   @return  none
+*/
+extern void SCOPE_Tick(void);
+
+/**
+ *  @brief   Send the oldest buffered sample, call from the main loop
+ *  @param   none
+ *  @return  1 if a frame was queued, 0 if there was nothing to send or
+ *           no room in the transmit buffer
+ */
+extern unsigned char SCOPE_Flush(void);
+
+/**@}*/
+
+#endif // SCOPE_H
@@ -0,0 +1,14 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+/************************************************************************
+Title:    Host stand-in for <avr/interrupt.h>
+*************************************************************************/
+#include <avr/io.h>
+
+/* interrupt handlers are plain functions, sim.c calls them */
+#define ISR(vector) void vector(void); void vector(void)
+
+#define sei()   (SREG |=  (1<<SREG_I))
+#define cli()   (SREG &= ~(1<<SREG_I))
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+/************************************************************************
+Title:    Host stand-in for <avr/io.h>, the USART0 of an ATmega328P
+*************************************************************************/
+#include <stdint.h>
+
+extern volatile uint8_t sim_sreg, sim_ucsr0a, sim_ucsr0b, sim_ucsr0c;
+extern volatile uint8_t sim_ubrr0h, sim_ubrr0l, sim_prr;
+extern volatile uint8_t sim_udr0;
+extern volatile uint8_t sim_portd, sim_ddrd;
+extern volatile uint8_t *sim_status_reg(void);
+
+/* status accesses go through the model, which may let time pass there */
+#define SREG        sim_sreg
+#define UCSR0A      (*sim_status_reg())
+#define UCSR0B      sim_ucsr0b
+#define UCSR0C      sim_ucsr0c
+#define UBRR0H      sim_ubrr0h
+#define UBRR0L      sim_ubrr0l
+#define UDR0        sim_udr0
+#define PRR         sim_prr
+
+/* e.g. the RS-485 driver enable pin */
+#define PORTD       sim_portd
+#define DDRD        sim_ddrd
+
+#define SREG_I      7
+
+#define RXC0        7
+#define TXC0        6
+#define UDRE0       5
+#define FE0         4
+#define DOR0        3
+#define UPE0        2
+#define U2X0        1
+#define MPCM0       0
+
+#define RXCIE0      7
+#define TXCIE0      6
+#define UDRIE0      5
+#define RXEN0       4
+#define TXEN0       3
+
+#define UMSEL00     6
+#define UCSZ01      2
+#define UCSZ00      1
+#define UCPHA0      1
+#define UCPOL0      0
+
+#define PRUSART0    1
+
+#define PD2         2
+
+#define USART_RX_vect    sim_vect_rx
+#define USART_UDRE_vect  sim_vect_udre
+#define USART_TX_vect    sim_vect_tx
+
+#endif
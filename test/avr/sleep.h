@@ -0,0 +1,7 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+/* host stand-in for <avr/sleep.h>, sleeping returns at once */
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()
+#endif
@@ -0,0 +1,70 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+/************************************************************************
+Title:    Host stand-in for <avr/io.h>, the USART0 of an ATmega4809
+*************************************************************************/
+#include <stdint.h>
+
+typedef struct USART_struct {
+    volatile uint8_t  RXDATAL;
+    volatile uint8_t  RXDATAH;
+    volatile uint8_t  TXDATAL;
+    volatile uint8_t  TXDATAH;
+    volatile uint8_t  STATUS;
+    volatile uint8_t  CTRLA;
+    volatile uint8_t  CTRLB;
+    volatile uint8_t  CTRLC;
+    volatile uint16_t BAUD;
+} USART_t;
+
+extern volatile uint8_t sim_sreg;
+extern volatile uint8_t sim_portd, sim_ddrd;
+extern USART_t *sim_usart(void);
+
+/* every access goes through the model, which may let time pass there */
+#define SREG        sim_sreg
+#define USART0      (*sim_usart())
+
+/* e.g. the RS-485 driver enable pin */
+#define VPORTD_OUT  sim_portd
+#define VPORTD_DIR  sim_ddrd
+
+#define SREG_I      7
+
+/* RXDATAH */
+#define USART_RXCIF_bp        7
+#define USART_BUFOVF_bm       0x40
+#define USART_FERR_bm         0x04
+#define USART_PERR_bm         0x02
+
+/* STATUS */
+#define USART_TXCIF_bp        6
+#define USART_DREIF_bp        5
+#define USART_DREIF_bm        0x20
+
+/* CTRLA */
+#define USART_RXCIE_bp        7
+#define USART_TXCIE_bp        6
+#define USART_DREIE_bp        5
+#define USART_RS485_EXT_gc    0x01
+
+/* CTRLB */
+#define USART_RXEN_bp         7
+#define USART_RXEN_bm         0x80
+#define USART_TXEN_bp         6
+#define USART_TXEN_bm         0x40
+#define USART_SFDEN_bm        0x10
+#define USART_RXMODE_CLK2X_gc 0x02
+
+/* CTRLC */
+#define USART_CMODE_MSPI_gc   0xC0
+#define USART_UCPHA_bm        0x02
+#define USART_CHSIZE_8BIT_gc  0x03
+
+#define PIN2_bp     2
+
+#define USART0_RXC_vect  sim_vect_rx
+#define USART0_DRE_vect  sim_vect_udre
+#define USART0_TXC_vect  sim_vect_tx
+
+#endif
@@ -0,0 +1,319 @@
+/************************************************************************
+Title:    Simulated half duplex RS-485 bus with many nodes
+*************************************************************************/
+
+/*
+ *  Every node runs node.c, the library and its own USART model. Their
+ *  variables are linked into the sections node_data and node_bss, one
+ *  image per node is swapped in to run it. All nodes run in turns of half
+ *  a bit time in virtual time; a node that only waits for a character
+ *  sleeps until one arrives.
+ *
+ *  A character on the bus is driven by its node from the start bit as long
+ *  as the driver enable of that node is high. Receivers sample each bit in
+ *  its middle, bits after DE went low read as the idle level of the biased
+ *  bus, without DE at the start bit there is no character. Any other
+ *  driver enabled while the character is sampled, up to the middle of its
+ *  stop bit, is a collision and the receivers get a damaged character with
+ *  a framing error; this covers two nodes sending at once as well as a node
+ *  that starts before the last sender released the bus. The character
+ *  reaches each receiver delayed by the propagation along the cable, the
+ *  nodes sit in a row at equal distances.
+ *
+ *  The master's result is printed per run:
+ *
+ *      bus -n 32 -k 3 -b 115200
+ *
+ *  gives the time of a round over all nodes and the answers per second for
+ *  32 nodes, "make bench" the same for 2 to 128 nodes. The exit code is 1 if
+ *  a poll went unanswered or characters collided.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "sim.h"
+#include "bus.h"
+
+#define BUS_NODES    128
+#define BUS_DE_LOG   8              /* driver enable periods kept per node */
+#define BUS_CHARS    (4 * BUS_NODES)
+
+/* the variables of node.c and the library it includes */
+extern char __start_node_data[], __stop_node_data[];
+extern char __start_node_bss[], __stop_node_bss[];
+
+#define DATA_SIZE  ((size_t)(__stop_node_data - __start_node_data))
+#define BSS_SIZE   ((size_t)(__stop_node_bss - __start_node_bss))
+
+/* settings, see usage() */
+static struct node_config config = {
+    .nodes    = 8,
+    .baudrate = 115200,
+    .work     = 400,
+    .isr_cost = 60,
+};
+static double        gap_bits = 2;
+static double        meters   = 10;
+static unsigned long rounds   = 3;
+
+static struct node {
+    char    *image;
+    int      asleep;
+    uint64_t de_on[BUS_DE_LOG];     /* driver enabled periods, latest last */
+    uint64_t de_off[BUS_DE_LOG];
+    unsigned de_count;
+} nodes[BUS_NODES];
+static char    *pristine;
+static unsigned running = BUS_NODES;
+
+/* characters sent, until every node has run past their stop bit */
+static struct bus_char {
+    uint64_t start;
+    uint32_t length;
+    unsigned node;
+    uint8_t  data;
+} chars[BUS_CHARS];
+static unsigned chars_count;
+
+/* characters on their way to each node, in order of arrival */
+static struct arrival {
+    uint64_t time;
+    uint8_t  data;
+    uint8_t  errors;
+} *arrivals[BUS_NODES];
+static unsigned arrivals_count[BUS_NODES];
+
+static unsigned long collisions, delivered;
+static double        prop_cycles;  /* between neighbours */
+
+
+/*
+ *  make node n the one whose variables are in place
+ */
+static void swap_in(unsigned n)
+{
+    if ( n == running )
+        return;
+    if ( running != BUS_NODES ) {
+        memcpy(nodes[running].image, __start_node_data, DATA_SIZE);
+        memcpy(nodes[running].image + DATA_SIZE, __start_node_bss, BSS_SIZE);
+    }
+    memcpy(__start_node_data, nodes[n].image, DATA_SIZE);
+    memcpy(__start_node_bss, nodes[n].image + DATA_SIZE, BSS_SIZE);
+    running = n;
+}
+
+
+void bus_tx(uint64_t start, uint32_t length, uint8_t data)
+{
+    if ( chars_count == BUS_CHARS ) {
+        fprintf(stderr, "bus: more than %d characters on the way\n", BUS_CHARS);
+        exit(2);
+    }
+    chars[chars_count].start  = start;
+    chars[chars_count].length = length;
+    chars[chars_count].node   = running;
+    chars[chars_count].data   = data;
+    chars_count++;
+}
+
+
+void bus_de(uint64_t time, unsigned on)
+{
+    struct node *n = &nodes[running];
+
+    if ( on ) {
+        if ( n->de_count == BUS_DE_LOG ) {
+            memmove(n->de_on, n->de_on + 1, (BUS_DE_LOG - 1) * sizeof(n->de_on[0]));
+            memmove(n->de_off, n->de_off + 1, (BUS_DE_LOG - 1) * sizeof(n->de_off[0]));
+            n->de_count--;
+        }
+        n->de_on[n->de_count]  = time;
+        n->de_off[n->de_count] = UINT64_MAX;
+        n->de_count++;
+    }else if ( n->de_count ) {
+        n->de_off[n->de_count - 1] = time;
+    }
+}
+
+
+static uint64_t propagation(unsigned a, unsigned b)
+{
+    return (uint64_t)((a > b ? a - b : b - a) * prop_cycles + 0.5);
+}
+
+
+/*
+ *  what the receivers make of a character, -1 if they see none
+ */
+static int on_the_bus(const struct bus_char *c, uint8_t *errors)
+{
+    double   bit    = c->length / 10.0;
+    uint64_t sample = c->start + (uint64_t)(9.5 * bit);
+    uint64_t off = 0, p;
+    unsigned n, i;
+    int      data = c->data;
+
+    /* the sender's own driver from the start bit on */
+    for ( i = 0; i < nodes[c->node].de_count; i++ )
+        if ( nodes[c->node].de_on[i] <= c->start && nodes[c->node].de_off[i] > c->start )
+            off = nodes[c->node].de_off[i];
+    if ( off < c->start + (uint64_t)(0.5 * bit) )
+        return -1;
+    for ( i = 0; i < 8; i++ )
+        if ( off <= c->start + (uint64_t)((i + 1.5) * bit) )
+            data |= 1 << i;
+
+    /* any other driver enabled meanwhile, as far as the signals meet */
+    *errors = 0;
+    for ( n = 0; n < config.nodes; n++ ) {
+        if ( n == c->node )
+            continue;
+        p = propagation(n, c->node);
+        for ( i = 0; i < nodes[n].de_count; i++ )
+            if ( nodes[n].de_on[i] < sample + p
+                 && (nodes[n].de_off[i] == UINT64_MAX || nodes[n].de_off[i] + p > c->start) )
+                *errors = SIM_FE;
+    }
+    /* what the receivers make of two drivers is undefined */
+    if ( *errors )
+        data ^= 0x5A;
+    return data & 0xFF;
+}
+
+
+/*
+ *  characters whose stop bit all nodes have run past go to the receivers
+ */
+static void deliver(uint64_t now)
+{
+    struct arrival *a;
+    unsigned        i, k, n, m;
+    uint8_t         errors;
+    uint64_t        t;
+    int             data;
+
+    for ( i = 0, k = 0; i < chars_count; i++ ) {
+        if ( chars[i].start + (uint64_t)(9.5 * chars[i].length / 10.0) > now ) {
+            chars[k++] = chars[i];
+            continue;
+        }
+        data = on_the_bus(&chars[i], &errors);
+        if ( data < 0 )
+            continue;
+        if ( errors )
+            collisions++;
+        delivered++;
+        for ( n = 0; n < config.nodes; n++ ) {
+            if ( n == chars[i].node )
+                continue;
+            t = chars[i].start + chars[i].length + propagation(n, chars[i].node);
+            a = arrivals[n];
+            /* in order of arrival */
+            for ( m = arrivals_count[n]; m > 0 && a[m - 1].time > t; m-- )
+                a[m] = a[m - 1];
+            a[m].time   = t;
+            a[m].data   = (uint8_t)data;
+            a[m].errors = errors;
+            if ( ++arrivals_count[n] == BUS_CHARS ) {
+                fprintf(stderr, "bus: node %u receives more than %d characters\n", n, BUS_CHARS);
+                exit(2);
+            }
+            nodes[n].asleep = 0;
+        }
+    }
+    chars_count = k;
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-n nodes] [-k rounds] [-b baud] [-g turnaround gap in bits]\n"
+        "          [-m meters between nodes] [-w cycles per main loop pass]\n"
+        "          [-i cycles per interrupt] [-d (last node answers for node 1)]\n", name);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct node_result r;
+    uint64_t           now = 0, quantum, limit;
+    unsigned           n, i;
+    int                opt;
+    double             round_ms;
+
+
+    while ( (opt = getopt(argc, argv, "n:k:b:g:m:w:i:d")) != -1 ) {
+        switch ( opt ) {
+        case 'n': config.nodes    = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'k': rounds          = strtoul(optarg, NULL, 0); break;
+        case 'b': config.baudrate = strtoul(optarg, NULL, 0); break;
+        case 'g': gap_bits        = strtod(optarg, NULL); break;
+        case 'm': meters          = strtod(optarg, NULL); break;
+        case 'w': config.work     = strtoul(optarg, NULL, 0); break;
+        case 'i': config.isr_cost = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': config.twin     = 1; break;
+        default:  usage(argv[0]);
+        }
+    }
+    if ( config.nodes < 2 || config.nodes > BUS_NODES || rounds == 0 )
+        usage(argv[0]);
+
+    /* 5 ns per meter of cable */
+    prop_cycles = meters * 5e-9 * F_CPU;
+    config.gap  = (unsigned long)(gap_bits * F_CPU / config.baudrate);
+    quantum     = F_CPU / config.baudrate / 2;
+    if ( quantum == 0 )
+        quantum = 1;
+
+    /* every node starts from the variables as loaded */
+    pristine = malloc(DATA_SIZE + BSS_SIZE);
+    memcpy(pristine, __start_node_data, DATA_SIZE);
+    memcpy(pristine + DATA_SIZE, __start_node_bss, BSS_SIZE);
+    for ( n = 0; n < config.nodes; n++ ) {
+        nodes[n].image = malloc(DATA_SIZE + BSS_SIZE);
+        arrivals[n]    = malloc(BUS_CHARS * sizeof(*arrivals[n]));
+        if ( !nodes[n].image || !arrivals[n] ) {
+            perror("bus");
+            return 2;
+        }
+        memcpy(nodes[n].image, pristine, DATA_SIZE + BSS_SIZE);
+        swap_in(n);
+        node_init(n, &config);
+    }
+
+    /* a round takes less than a poll timeout per node */
+    limit = (uint64_t)(rounds + 1) * config.nodes
+            * (30 * 10 * F_CPU / config.baudrate + 2 * (config.gap + config.work));
+    for (;;) {
+        now += quantum;
+        for ( n = 0; n < config.nodes; n++ ) {
+            if ( nodes[n].asleep && !arrivals_count[n] )
+                continue;
+            swap_in(n);
+            for ( i = 0; i < arrivals_count[n]; i++ )
+                node_rx(arrivals[n][i].time, arrivals[n][i].data, arrivals[n][i].errors);
+            arrivals_count[n] = 0;
+            nodes[n].asleep = node_run(now);
+        }
+        deliver(now);
+
+        swap_in(0);
+        node_result(&r);
+        if ( r.cycles >= rounds || now > limit )
+            break;
+    }
+
+    round_ms = r.cycles ? r.cycle_time * 1000.0 / r.cycles / F_CPU : 0;
+    printf("bus: %3u nodes, %lu bps: round %8.2f ms, %7.1f answers/s, %7.1f bytes/s, "
+           "%lu polls, %lu timeouts, %lu of %lu characters collided\n",
+           config.nodes, config.baudrate, round_ms,
+           r.answers * F_CPU / (double)now, r.answers * NODE_DATA * F_CPU / (double)now,
+           r.polls, r.timeouts, collisions, delivered);
+    return r.timeouts != 0 || collisions != 0 || r.cycles < rounds;
+}
@@ -0,0 +1,59 @@
+#ifndef BUS_H
+#define BUS_H
+/************************************************************************
+Title:    Simulated RS-485 bus of many nodes, interface of bus and node
+*************************************************************************/
+
+/*
+ *  node.c is the firmware of one node: the library with RS-485 driver
+ *  enable, the USART model and the debug channel, node 0 being the master
+ *  that polls all others. Its variables are linked into sections of their
+ *  own, bus.c swaps them to run one node after the other and carries the
+ *  characters between them.
+ */
+
+#include <stdint.h>
+
+/* what all nodes are built for */
+struct node_config {
+    unsigned      nodes;            /* node 0 polls 1 .. nodes-1            */
+    unsigned long baudrate;
+    unsigned long work;             /* cycles per main loop pass            */
+    unsigned      isr_cost;         /* cycles per interrupt                 */
+    unsigned long gap;              /* cycles from the last character
+                                       received to the next transmission    */
+    unsigned      twin;             /* the last node answers for node 1 too */
+};
+
+/* the master's count */
+struct node_result {
+    unsigned long polls;
+    unsigned long answers;
+    unsigned long timeouts;
+    unsigned long cycles;           /* rounds over all nodes completed      */
+    uint64_t      cycle_time;       /* cycles of the completed rounds       */
+};
+
+/* answer payload besides address and sequence number */
+#define NODE_DATA  4
+
+/** @brief  Start a node with the given address */
+extern void node_init(unsigned id, const struct node_config *config);
+
+/** @brief  Run the node up to the given cycle
+ *  @return 1 if it waits for a character and nothing else */
+extern int node_run(uint64_t until);
+
+/** @brief  A character arrives at the node */
+extern void node_rx(uint64_t time, uint8_t data, uint8_t errors);
+
+/** @brief  The master's count */
+extern void node_result(struct node_result *result);
+
+/** @brief  The node running starts a character on its transmitter */
+extern void bus_tx(uint64_t start, uint32_t length, uint8_t data);
+
+/** @brief  The driver enable of the node running changes */
+extern void bus_de(uint64_t time, unsigned on);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+/************************************************************************
+Title:    Host build configuration of the library tests
+*************************************************************************/
+#define F_CPU 16000000UL
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/* data register and TXC accesses go to the USART model in sim.c */
+#define UART_RX_DATA     sim_rx_data()
+#define UART_TX_DATA     (*sim_tx_data())
+#define UART_TXC_CLEAR() sim_txc_clear()
+
+extern uint8_t sim_rx_data(void);
+extern uint8_t *sim_tx_data(void);
+extern void sim_txc_clear(void);
+
+/* the UDRE interrupt enable goes to the waveform of the simulation */
+#define UART_TRACE_UDRIE(on) sim_trace_udrie(on)
+
+extern void sim_trace_udrie(unsigned on);
+
+#endif
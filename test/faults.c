@@ -0,0 +1,277 @@
+/************************************************************************
+Title:    Receive errors of the line and how the library reports them
+*************************************************************************/
+
+/*
+ *  The USART model injects what a test fixture never produces: framing
+ *  and parity errors, breaks, bit flips, baud rate skew and a receive
+ *  interrupt served too late, which overruns the receiver. The characters
+ *  go through the real receive interrupt, the test checks the error codes
+ *  UART_CharGetNonBlocking() reports, that they stick until read and what
+ *  the debug channel makes of damaged frames.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "sim.h"
+#include "../uart.h"
+#include "../debug.h"
+
+#define FRAMES   500
+
+static unsigned failures;
+
+
+static void check(int ok, const char *what)
+{
+    if ( !ok ) {
+        failures++;
+        printf("FAIL %s\n", what);
+    }
+}
+
+
+static void start(void)
+{
+    UART_Init(0);
+    sim_reset();
+}
+
+
+/*
+ *  the error codes of single characters
+ */
+static void test_flags(void)
+{
+    start();
+    sim_rx_frame('a', SIM_FE);
+    check(UART_CharGetNonBlocking() == (UART_FRAME_ERROR | 'a'),
+          "missing stop bit gives UART_FRAME_ERROR");
+
+    sim_rx_frame('b', SIM_PE);
+    check(UART_CharGetNonBlocking() == (UART_PARITY_ERROR | 'b'),
+          "parity error gives UART_PARITY_ERROR");
+
+    sim_rx_break();
+    check(UART_CharGetNonBlocking() == (UART_BREAK | UART_FRAME_ERROR),
+          "break gives UART_BREAK with UART_FRAME_ERROR and 0x00");
+
+    /* a zero with a good stop bit is data */
+    sim_rx_event(0x00);
+    check(UART_CharGetNonBlocking() == 0x00, "0x00 without framing error is no break");
+
+    /* the USART can't see a flipped bit, that is up to the protocol */
+    sim_rx_event('c' ^ 0x08);
+    check(UART_CharGetNonBlocking() == ('c' ^ 0x08), "bit flip passes unflagged");
+
+    check(UART_CharGetNonBlocking() == UART_NO_DATA, "no data left");
+}
+
+
+/*
+ *  errors stick until a read reports them, all that came together
+ */
+static void test_sticky(void)
+{
+    unsigned int c;
+
+    start();
+    sim_rx_frame('x', SIM_FE);
+    sim_rx_frame('y', SIM_PE);
+    sim_rx_event('z');
+
+    c = UART_CharGetNonBlocking();
+    check(c == (UART_FRAME_ERROR | UART_PARITY_ERROR | 'x'),
+          "first read reports UART_FRAME_ERROR | UART_PARITY_ERROR");
+    check(UART_CharGetNonBlocking() == 'y', "errors are cleared once reported");
+    check(UART_CharGetNonBlocking() == 'z', "good character after errors");
+}
+
+
+/*
+ *  interrupts disabled for four character times: two characters in the
+ *  FIFO, one in the shift register and the fourth overwrites that one
+ */
+static void test_overrun(void)
+{
+    unsigned int c;
+
+    start();
+    SREG &= ~(1<<SREG_I);
+    sim_rx_event('0');
+    sim_rx_event('1');
+    sim_rx_event('2');
+    sim_rx_event('3');
+    sim_sei();
+
+    c = UART_CharGetNonBlocking();
+    check(c == (UART_OVERRUN_ERROR | '0'), "late service gives UART_OVERRUN_ERROR");
+    check(UART_CharGetNonBlocking() == '1', "second character kept");
+    check(UART_CharGetNonBlocking() == '3', "overrun loses the character in the shift register");
+    check(UART_CharGetNonBlocking() == UART_NO_DATA, "no data left after overrun");
+
+    /* three characters fit, the shift register holds the third */
+    SREG &= ~(1<<SREG_I);
+    sim_rx_event('4');
+    sim_rx_event('5');
+    sim_rx_event('6');
+    sim_sei();
+    check(UART_CharGetNonBlocking() == '4' && UART_CharGetNonBlocking() == '5'
+          && UART_CharGetNonBlocking() == '6', "three characters survive without overrun");
+}
+
+
+/*
+ *  the interrupt runs in time but the main loop doesn't read
+ */
+static void test_overflow(void)
+{
+    unsigned i;
+    unsigned c;
+
+    start();
+    for ( i = 0; i < UART_RX_BUFFER_SIZE + 1; i++ )
+        sim_rx_event((uint8_t)i);
+
+    c = UART_CharGetNonBlocking();
+    check(c == (UART_BUFFER_OVERFLOW | 0), "full ring gives UART_BUFFER_OVERFLOW");
+    for ( i = 1; i < UART_RX_BUFFER_SIZE - 1; i++ )
+        if ( UART_CharGetNonBlocking() != i )
+            break;
+    check(i == UART_RX_BUFFER_SIZE - 1, "ring content kept on overflow");
+    check(UART_CharGetNonBlocking() == UART_NO_DATA, "characters beyond the ring are dropped");
+}
+
+
+/*
+ *  a sender with a baud rate error, the receiver samples in the middle of
+ *  its own bit times
+ */
+static unsigned skewed_errors(double skew)
+{
+    unsigned i;
+    unsigned errors = 0;
+    uint16_t r;
+
+    start();
+    for ( i = 0; i < 256; i++ ) {
+        r = sim_rx_skewed((uint8_t)i, skew);
+        sim_rx_frame((uint8_t)r, (uint8_t)(r >> 8));
+        if ( UART_CharGetNonBlocking() != i )
+            errors++;
+    }
+    return errors;
+}
+
+
+static void test_skew(void)
+{
+    unsigned slow2 = skewed_errors(0.02), fast2 = skewed_errors(-0.02);
+    unsigned slow6 = skewed_errors(0.06), fast6 = skewed_errors(-0.06);
+
+    printf("faults: baud skew +2%% %u, -2%% %u, +6%% %u, -6%% %u of 256 characters damaged\n",
+           slow2, fast2, slow6, fast6);
+    check(slow2 == 0 && fast2 == 0, "2 % baud skew is tolerated");
+    check(slow6 != 0 && fast6 != 0, "6 % baud skew damages characters");
+}
+
+
+/*
+ *  debug channel frames through a noisy line
+ */
+static uint8_t  sent_payload[DEBUG_MAX_PAYLOAD];
+static uint8_t  sent_len;
+static unsigned dispatched;
+static unsigned bad_dispatch;
+
+static void handler(const unsigned char *payload, unsigned char len)
+{
+    dispatched++;
+    if ( len != sent_len || memcmp(payload, sent_payload, len) )
+        bad_dispatch++;
+}
+
+
+static uint32_t lcg = 12345;
+
+static unsigned rnd(unsigned n)
+{
+    lcg = lcg * 1103515245u + 12345u;
+    return (lcg >> 16) % n;
+}
+
+
+static void receive(uint8_t data, uint8_t errors)
+{
+    sim_rx_frame(data, errors);
+    DEBUG_Input(UART_CharGetNonBlocking());
+}
+
+
+static void test_debug(void)
+{
+    uint8_t  frame[DEBUG_MAX_PAYLOAD + 4];
+    unsigned n, i, len, damaged = 0, clean = 0, at, fault;
+    uint8_t  check_byte;
+
+    start();
+    DEBUG_Register('Z', handler);
+
+    for ( n = 0; n < FRAMES; n++ ) {
+        sent_len = (uint8_t)(1 + rnd(DEBUG_MAX_PAYLOAD));
+        for ( i = 0; i < sent_len; i++ )
+            sent_payload[i] = (uint8_t)(0x20 + rnd(0x60));
+        frame[0] = DEBUG_DLE;
+        frame[1] = 'Z';
+        frame[2] = sent_len;
+        check_byte = 'Z' ^ sent_len;
+        for ( i = 0; i < sent_len; i++ ) {
+            frame[3 + i] = sent_payload[i];
+            check_byte ^= sent_payload[i];
+        }
+        frame[3 + sent_len] = check_byte;
+        len = sent_len + 4;
+
+        /* every other frame gets one fault past the DLE */
+        fault = ( n & 1 ) ? 1 + rnd(3) : 0;
+        at    = 1 + rnd(len - 1);
+        for ( i = 0; i < len; i++ ) {
+            if ( i != at || fault == 0 )
+                receive(frame[i], 0);
+            else if ( fault == 1 )
+                receive(frame[i] ^ (uint8_t)(1 << rnd(8)), 0);
+            else if ( fault == 2 )
+                receive(frame[i], SIM_FE);
+            else
+                sim_rx_break(), DEBUG_Input(UART_CharGetNonBlocking());
+        }
+        /* a damaged length may leave the decoder inside a frame, idle
+           characters run it out before the next one */
+        for ( i = 0; fault && i < DEBUG_MAX_PAYLOAD + 2; i++ )
+            receive('.', 0);
+        if ( fault )
+            damaged++;
+        else
+            clean++;
+    }
+
+    printf("faults: debug channel, %u clean and %u damaged frames, %u dispatched\n",
+           clean, damaged, dispatched);
+    check(bad_dispatch == 0, "damaged debug frame dispatched");
+    check(dispatched == clean, "every clean debug frame dispatched");
+}
+
+
+int main(void)
+{
+    test_flags();
+    test_sticky();
+    test_overrun();
+    test_overflow();
+    test_skew();
+    test_debug();
+
+    printf("faults: %u failures\n", failures);
+    return failures != 0;
+}
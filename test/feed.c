@@ -0,0 +1,116 @@
+#include "config.h"
+#include "uart.h"
+#include "fuzz.h"
+
+#define FEED_ESC 0xA5
+
+static const uint8_t *feed_data;
+static size_t         feed_size;
+static size_t         feed_pos;
+static int            feed_pause;
+
+
+void feed_start(const uint8_t *data, size_t size)
+{
+    feed_data  = data;
+    feed_size  = size;
+    feed_pos   = 0;
+    feed_pause = 0;
+}
+
+
+int feed_paused(void)
+{
+    return feed_pause;
+}
+
+
+void feed_resume(void)
+{
+    feed_pause = 0;
+}
+
+
+int feed_done(void)
+{
+    return feed_pos >= feed_size;
+}
+
+
+/*
+ *  next received character in UART_CharGetNonBlocking() format
+ */
+static unsigned int feed_next(void)
+{
+    unsigned int flags = 0;
+    uint8_t      esc;
+
+    if ( feed_pause || feed_pos >= feed_size )
+        return UART_NO_DATA;
+
+    if ( feed_data[feed_pos] == FEED_ESC && feed_pos + 1 < feed_size ) {
+        esc = feed_data[feed_pos + 1];
+        if ( esc == 0 ) {
+            feed_pos += 2;
+            feed_pause = 1;
+            return UART_NO_DATA;
+        }
+        if ( esc == FEED_ESC ) {
+            feed_pos += 2;
+            return FEED_ESC;
+        }
+        if ( feed_pos + 2 >= feed_size ) {
+            feed_pos = feed_size;
+            return UART_NO_DATA;
+        }
+        flags = (esc << 8) & (UART_FRAME_ERROR | UART_OVERRUN_ERROR | UART_PARITY_ERROR
+                              | UART_BUFFER_OVERFLOW | UART_BREAK);
+        if ( !flags )
+            flags = UART_FRAME_ERROR;
+        feed_pos += 2;
+    }
+    return flags | feed_data[feed_pos++];
+}
+
+
+unsigned int UART_CharGetNonBlocking(void)
+{
+    return feed_next();
+}
+
+
+unsigned int UART_BlockGetNonBlocking(unsigned char *buf, unsigned int len)
+{
+    unsigned int count = 0;
+    unsigned int c;
+
+    /* like the library the block read passes no error flags on */
+    while ( count < len && !((c = feed_next()) & UART_NO_DATA) )
+        buf[count++] = (unsigned char)c;
+    return count;
+}
+
+
+int UART_CharsAvail(void)
+{
+    return !feed_pause && feed_pos < feed_size;
+}
+
+
+void UART_CharPutNonBlocking(unsigned char data)
+{
+    (void)data;
+}
+
+
+unsigned int UART_BlockPutNonBlocking(const unsigned char *buf, unsigned int len)
+{
+    (void)buf;
+    return len;
+}
+
+
+unsigned int UART_TxFree(void)
+{
+    return UART_TX_BUFFER_MASK;
+}
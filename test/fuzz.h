@@ -0,0 +1,37 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+/************************************************************************
+Title:    Fake UART receive side for the protocol decoder fuzz targets
+*************************************************************************/
+
+/*
+ *  The decoders get the fuzz input through UART_CharGetNonBlocking() and
+ *  UART_BlockGetNonBlocking() of feed.c instead of the real library.
+ *  Most bytes are passed on as they are, 0xA5 starts an escape:
+ *      0xA5 0xA5   a 0xA5 data byte
+ *      0xA5 0x00   a pause, the receive buffer runs empty until
+ *                  feed_resume(), the target lets its timeout expire
+ *      0xA5 n      the next byte comes with the UART error flags n << 8
+ *                  (framing error if n has none of them)
+ *  Everything the decoders transmit is discarded.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief  Start feeding a new input */
+extern void feed_start(const uint8_t *data, size_t size);
+
+/** @brief  Nonzero while a pause holds back the rest of the input */
+extern int feed_paused(void);
+
+/** @brief  Go on after a pause */
+extern void feed_resume(void);
+
+/** @brief  Nonzero once the input is used up */
+extern int feed_done(void);
+
+/** @brief  libFuzzer entry point, also called by fuzz_main.c */
+extern int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
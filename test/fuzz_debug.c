@@ -0,0 +1,52 @@
+/*
+ *  fuzz target of the debug frame receiver
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "uart.h"
+#include "debug.h"
+#include "fuzz.h"
+
+static void handler(const unsigned char *payload, unsigned char len)
+{
+    volatile unsigned char sum = 0;
+    unsigned char i;
+
+    if ( len > DEBUG_MAX_PAYLOAD ) {
+        fprintf(stderr, "debug: %u byte payload\n", len);
+        abort();
+    }
+    for ( i = 0; i < len; i++ )
+        sum ^= payload[i];
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    unsigned int c;
+    unsigned int r;
+
+    DEBUG_Register(0x00, handler);
+    DEBUG_Register('X', handler);
+    DEBUG_Register(DEBUG_DLE + 1, handler);
+    DEBUG_Register(0xFF, handler);
+
+    feed_start(data, size);
+    while ( !feed_done() ) {
+        c = UART_CharGetNonBlocking();
+        if ( c & UART_NO_DATA ) {
+            feed_resume();
+            continue;
+        }
+        r = DEBUG_Input(c);
+        if ( r != c && r != UART_NO_DATA ) {
+            fprintf(stderr, "debug: 0x%04x passed on as 0x%04x\n", c, r);
+            abort();
+        }
+    }
+
+    /* a damaged byte drops a half frame before the next input */
+    DEBUG_Input(UART_FRAME_ERROR);
+    return 0;
+}
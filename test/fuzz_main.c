@@ -0,0 +1,199 @@
+/*
+ *  Stand-alone driver for the fuzz targets where libFuzzer is not at hand,
+ *  e.g. with gcc: runs every file of the corpus, then random mutations of
+ *  it. Without coverage feedback this only explores near the seeds, build
+ *  the targets with clang -fsanitize=fuzzer instead of this file for that.
+ *
+ *  usage: fuzz-<target> [-runs=N] [-seed=N] corpus files or directories
+ */
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "fuzz.h"
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define __SANITIZE_ADDRESS__
+#endif
+#endif
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/common_interface_defs.h>
+#define FUZZ_DEATH_CALLBACK
+#endif
+
+#define FUZZ_MAX_INPUT   8192
+#define FUZZ_MAX_SEEDS   256
+
+static uint8_t *seeds[FUZZ_MAX_SEEDS];
+static size_t   seed_sizes[FUZZ_MAX_SEEDS];
+static unsigned seed_count;
+
+/* bytes the decoders care about */
+static const uint8_t magic[] = { 0x00, 0x01, 0x02, 0x04, 0x06, 0x10, 0x15, 0x18,
+                                 0x43, 0x7F, 0x80, 0xA5, 0xFB, 0xFE, 0xFF };
+
+
+static void load(const char *path)
+{
+    struct stat    st;
+    struct dirent *e;
+    DIR           *d;
+    FILE          *f;
+    char           name[1024];
+
+    if ( stat(path, &st) != 0 ) {
+        perror(path);
+        exit(2);
+    }
+    if ( S_ISDIR(st.st_mode) ) {
+        d = opendir(path);
+        while ( d && (e = readdir(d)) ) {
+            if ( e->d_name[0] == '.' )
+                continue;
+            snprintf(name, sizeof(name), "%s/%s", path, e->d_name);
+            load(name);
+        }
+        if ( d )
+            closedir(d);
+        return;
+    }
+    if ( seed_count == FUZZ_MAX_SEEDS || st.st_size > FUZZ_MAX_INPUT )
+        return;
+    f = fopen(path, "rb");
+    if ( !f ) {
+        perror(path);
+        exit(2);
+    }
+    seeds[seed_count] = malloc(st.st_size ? st.st_size : 1);
+    seed_sizes[seed_count] = fread(seeds[seed_count], 1, st.st_size, f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(seeds[seed_count], seed_sizes[seed_count]);
+    seed_count++;
+}
+
+
+/* the input being run, written to crash-input when it fails */
+static uint8_t  current[FUZZ_MAX_INPUT];
+static size_t   current_size;
+
+
+static void save_crash(void)
+{
+    FILE *f = fopen("crash-input", "wb");
+
+    if ( f ) {
+        fwrite(current, 1, current_size, f);
+        fclose(f);
+        fprintf(stderr, "input written to crash-input\n");
+    }
+}
+
+
+static void on_abort(int sig)
+{
+    save_crash();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+static size_t mutate(uint8_t *buf, size_t size)
+{
+    unsigned n = 1 + rand() % 4;
+    size_t   pos, len, i;
+    unsigned other;
+
+    while ( n-- ) {
+        pos = size ? (size_t)rand() % size : 0;
+        switch ( rand() % 6 ) {
+        case 0:     /* flip a bit */
+            if ( size )
+                buf[pos] ^= 1 << (rand() % 8);
+            break;
+        case 1:     /* replace a byte */
+            if ( size )
+                buf[pos] = rand() % 2 ? magic[rand() % sizeof(magic)] : rand();
+            break;
+        case 2:     /* insert a byte */
+            if ( size < FUZZ_MAX_INPUT ) {
+                memmove(buf + pos + 1, buf + pos, size - pos);
+                buf[pos] = rand() % 2 ? magic[rand() % sizeof(magic)] : rand();
+                size++;
+            }
+            break;
+        case 3:     /* delete a run */
+            len = 1 + rand() % 16;
+            if ( pos + len > size )
+                len = size - pos;
+            memmove(buf + pos, buf + pos + len, size - pos - len);
+            size -= len;
+            break;
+        case 4:     /* repeat a run */
+            len = 1 + rand() % 64;
+            if ( pos + len > size )
+                len = size - pos;
+            if ( size + len <= FUZZ_MAX_INPUT ) {
+                memmove(buf + pos + len, buf + pos, size - pos);
+                size += len;
+            }
+            break;
+        case 5:     /* splice in a piece of another seed */
+            other = rand() % seed_count;
+            len = seed_sizes[other] ? (size_t)rand() % seed_sizes[other] : 0;
+            i   = seed_sizes[other] ? (size_t)rand() % (seed_sizes[other] - len + 1) : 0;
+            if ( pos + len > FUZZ_MAX_INPUT )
+                len = FUZZ_MAX_INPUT - pos;
+            memcpy(buf + pos, seeds[other] + i, len);
+            if ( pos + len > size )
+                size = pos + len;
+            break;
+        }
+    }
+    return size;
+}
+
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[FUZZ_MAX_INPUT];
+    unsigned long  runs = 100000, r;
+    unsigned       seed = 1;
+    size_t         size;
+    clock_t        start;
+    int            i;
+
+    for ( i = 1; i < argc; i++ ) {
+        if ( strncmp(argv[i], "-runs=", 6) == 0 )
+            runs = strtoul(argv[i] + 6, NULL, 0);
+        else if ( strncmp(argv[i], "-seed=", 6) == 0 )
+            seed = strtoul(argv[i] + 6, NULL, 0);
+        else
+            load(argv[i]);
+    }
+    if ( seed_count == 0 ) {
+        fprintf(stderr, "usage: %s [-runs=N] [-seed=N] corpus...\n", argv[0]);
+        return 2;
+    }
+
+    signal(SIGABRT, on_abort);
+#ifdef FUZZ_DEATH_CALLBACK
+    __sanitizer_set_death_callback(save_crash);
+#endif
+    srand(seed);
+    start = clock();
+    for ( r = 0; r < runs; r++ ) {
+        i = rand() % seed_count;
+        memcpy(buf, seeds[i], seed_sizes[i]);
+        size = mutate(buf, seed_sizes[i]);
+        memcpy(current, buf, size);
+        current_size = size;
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    printf("%s: %u seeds, %lu mutations in %.1f s\n", argv[0], seed_count, runs,
+           (double)(clock() - start) / CLOCKS_PER_SEC);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ *  fuzz target of the page upload receiver
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "upload.h"
+#include "fuzz.h"
+
+static unsigned int next_page;
+static int          writing;
+
+
+static void commit(unsigned int page, const unsigned char *data)
+{
+    volatile unsigned char sum = 0;
+    unsigned int i;
+
+    if ( writing || page != next_page ) {
+        fprintf(stderr, "upload: page %u committed, %u expected%s\n",
+                page, next_page, writing ? " during a write" : "");
+        abort();
+    }
+    for ( i = 0; i < UPLOAD_PAGE_SIZE; i++ )
+        sum ^= data[i];
+    next_page++;
+    writing = 1;
+}
+
+
+/* the flash write takes until after the next poll */
+static unsigned char poll(void)
+{
+    unsigned char status = UPLOAD_Poll();
+
+    if ( writing ) {
+        writing = 0;
+        UPLOAD_Committed();
+    }
+    return status;
+}
+
+
+static unsigned char timeout(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < UPLOAD_TIMEOUT; i++ )
+        UPLOAD_Tick();
+    return poll();
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    unsigned char status;
+    unsigned int  i;
+
+    next_page = 0;
+    writing   = 0;
+    UPLOAD_Init(commit);
+    feed_start(data, size);
+
+    status = poll();
+    while ( status == UPLOAD_BUSY && !feed_done() ) {
+        if ( feed_paused() ) {
+            status = timeout();
+            feed_resume();
+        }
+        status = poll();
+    }
+
+    /* the sender is gone, the retries must run out */
+    for ( i = 0; status == UPLOAD_BUSY; i++ ) {
+        if ( i > UPLOAD_RETRIES + 2 ) {
+            fprintf(stderr, "upload: no end after %u timeouts\n", i);
+            abort();
+        }
+        status = timeout();
+    }
+    return 0;
+}
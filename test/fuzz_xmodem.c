@@ -0,0 +1,84 @@
+/*
+ *  fuzz target of the XMODEM/YMODEM receiver, the first input byte picks
+ *  the protocol
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "xmodem.h"
+#include "fuzz.h"
+
+static unsigned long block_bytes;   /* data since the last block callback */
+static int           finished;
+
+
+static void data_cb(unsigned char c)
+{
+    (void)c;
+    if ( finished || ++block_bytes > 1024 ) {
+        fprintf(stderr, "xmodem: data outside a block\n");
+        abort();
+    }
+}
+
+
+static void block_cb(unsigned char valid)
+{
+    (void)valid;
+    if ( finished ) {
+        fprintf(stderr, "xmodem: block callback after the end\n");
+        abort();
+    }
+    block_bytes = 0;
+}
+
+
+/* a stalled sender: let the timeout expire */
+static unsigned char timeout(void)
+{
+    unsigned int i;
+
+    for ( i = 0; i < XMODEM_TIMEOUT; i++ )
+        XMODEM_Tick();
+    return XMODEM_Poll();
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    unsigned char status;
+    unsigned int  i;
+
+    if ( size == 0 )
+        return 0;
+
+    block_bytes = 0;
+    finished    = 0;
+    XMODEM_Init(data[0] & 1 ? XMODEM_MODE_YMODEM : XMODEM_MODE_XMODEM, data_cb, block_cb);
+    feed_start(data + 1, size - 1);
+
+    status = XMODEM_Poll();
+    while ( status == XMODEM_BUSY && !feed_done() ) {
+        if ( feed_paused() ) {
+            status = timeout();
+            feed_resume();
+        }
+        status = XMODEM_Poll();
+    }
+
+    /* the sender is gone, the retries must run out */
+    for ( i = 0; status == XMODEM_BUSY; i++ ) {
+        if ( i > XMODEM_RETRIES ) {
+            fprintf(stderr, "xmodem: no end after %u timeouts\n", i);
+            abort();
+        }
+        status = timeout();
+    }
+
+    finished = 1;
+    if ( XMODEM_Poll() != status ) {
+        fprintf(stderr, "xmodem: status changed after the end\n");
+        abort();
+    }
+    return 0;
+}
@@ -0,0 +1,517 @@
+/************************************************************************
+Title:    Exhaustive interrupt interleaving test of the ringbuffer code
+*************************************************************************/
+
+/*
+ *  Every main loop call of the library under test is single stepped with
+ *  the x86 trap flag. A run picks one instruction boundary of the call and
+ *  lets one or two events happen there: a character arrives, or a
+ *  character time passes on TXD, each with the interrupt handlers the
+ *  USART model runs for it, or another interrupt handler puts a character.
+ *  Where the call has interrupts disabled the events wait until it enables
+ *  them again, as they would on the AVR.
+ *
+ *  For every fill level of the small rings, every call and every
+ *  instruction boundary in it the run then checks that
+ *   - characters come out in the order they went in and none twice, those
+ *     of the main loop and those of the other handler each,
+ *   - a received character is lost only when the ring was full, and only
+ *     with UART_BUFFER_OVERFLOW reported on a later character,
+ *   - a transmitted character is lost only by UART_TxAbort(),
+ *   - UART_CharsAvail(), UART_RxFree(), UART_TxPending() and
+ *     UART_TxFree() return a level the ring really had during the call.
+ *
+ *  The library is included rather than linked to see its ring indices.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../uart.c"
+#include "sim.h"
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "the interleaving test single steps with the x86-64 trap flag on Linux"
+#endif
+
+/* a character time passes this often while a call waits for the ring */
+#define PROGRESS_STEPS  64
+/* steps after which a call is considered hung */
+#define HANG_STEPS      100000UL
+#define MAX_EVENTS      64
+/* characters put by another interrupt handler are numbered from here */
+#define ISR_BASE        0x80
+
+#define RX_LEVEL()  ((unsigned char)(UART_RxHead - UART_RxTail) & UART_RX_BUFFER_MASK)
+#define TX_LEVEL()  ((unsigned char)(UART_TxHead - UART_TxTail) & UART_TX_BUFFER_MASK)
+
+/*
+ *  operations of the main loop
+ */
+enum {
+    OP_GET, OP_AVAIL, OP_RXFREE, OP_BLOCKGET1, OP_BLOCKGET2, OP_BLOCKGET3, OP_FLUSH,
+    OP_RX_COUNT,
+    OP_PUT = OP_RX_COUNT, OP_BLOCKPUT1, OP_BLOCKPUT2, OP_BLOCKPUT3, OP_PENDING,
+    OP_TXFREE, OP_ABORT,
+    OP_COUNT
+};
+
+static const char * const op_names[OP_COUNT] = {
+    "UART_CharGetNonBlocking", "UART_CharsAvail", "UART_RxFree",
+    "UART_BlockGetNonBlocking(1)", "UART_BlockGetNonBlocking(2)",
+    "UART_BlockGetNonBlocking(3)", "UART_FlushBuffer",
+    "UART_CharPutNonBlocking", "UART_BlockPutNonBlocking(1)",
+    "UART_BlockPutNonBlocking(2)", "UART_BlockPutNonBlocking(3)",
+    "UART_TxPending", "UART_TxFree", "UART_TxAbort"
+};
+
+/*
+ *  state of a run, shared with the trap handler
+ */
+static volatile unsigned long steps;
+static volatile unsigned long inject_at;
+static volatile unsigned      inject_count;
+static volatile unsigned      pending;
+static volatile unsigned      progress;
+static int                    inject;
+
+/* kinds of events */
+enum { INJECT_RX, INJECT_TX, INJECT_PUT };
+
+/* received characters are numbered in the order they arrive */
+static unsigned      rx_next;
+static unsigned char rx_full_at[MAX_EVENTS];    /* ring was full then */
+static unsigned      got_val[MAX_EVENTS];
+static unsigned      got_flags[MAX_EVENTS];
+static unsigned      got_when[MAX_EVENTS];      /* rx_next on return */
+static unsigned      got_count;
+static unsigned      flush_mark;
+
+/* transmitted characters are numbered in the order they are queued */
+static unsigned      tx_next;
+static unsigned      abort_mark;
+static unsigned      isr_next;
+static unsigned      isr_abort_mark;
+
+static int           op;
+static int           result;
+static unsigned      level_before, level_after;
+
+static unsigned long runs;
+static unsigned      failures;
+
+
+/*
+ *  while another handler waits for UDRE a character time passes
+ */
+static void poll_tx(void)
+{
+    if ( sim_tx_busy() == 2 )
+        sim_tx_event();
+}
+
+
+/*
+ *  another interrupt handler puts a character, e.g. a debug message
+ */
+static void isr_put(void)
+{
+    uint8_t sreg = SREG;
+
+    if ( isr_next >= ISR_BASE + MAX_EVENTS ) {
+        fprintf(stderr, "too many events\n");
+        exit(2);
+    }
+    SREG &= ~(1<<SREG_I);
+    sim_poll = poll_tx;
+    UART_CharPutNonBlocking((unsigned char)isr_next++);
+    sim_poll = NULL;
+    SREG = sreg;
+}
+
+
+/*
+ *  an event, run from the trap handler or directly
+ */
+static void event(void)
+{
+    switch ( inject ) {
+    case INJECT_RX:
+        if ( rx_next >= MAX_EVENTS ) {
+            fprintf(stderr, "too many events\n");
+            exit(2);
+        }
+        rx_full_at[rx_next] = RX_LEVEL() == UART_RX_BUFFER_MASK;
+        sim_rx_event((unsigned char)rx_next++);
+        break;
+    case INJECT_TX:
+        sim_tx_event();
+        break;
+    case INJECT_PUT:
+        isr_put();
+        break;
+    }
+}
+
+
+/*
+ *  called after every instruction of a traced call
+ */
+static void trap(int sig, siginfo_t *info, void *context)
+{
+    (void)sig;
+    (void)info;
+    (void)context;
+
+    steps++;
+    if ( steps == inject_at )
+        pending += inject_count;
+    if ( inject != INJECT_RX && steps % PROGRESS_STEPS == 0 )
+        progress++;
+    if ( steps > HANG_STEPS ) {
+        fprintf(stderr, "%s hangs\n", op_names[op]);
+        _exit(2);
+    }
+
+    /* an interrupt can't be taken while the I flag is clear */
+    if ( (pending || progress) && (SREG & (1<<SREG_I)) ) {
+        while ( pending ) {
+            pending--;
+            event();
+        }
+        while ( progress ) {
+            progress--;
+            sim_tx_event();
+        }
+    }
+}
+
+
+static inline __attribute__((always_inline)) void trace_on(void)
+{
+    __asm__ volatile ( "pushfq\n\torq $0x100, (%%rsp)\n\tpopfq" ::: "memory", "cc" );
+}
+
+
+static inline __attribute__((always_inline)) void trace_off(void)
+{
+    __asm__ volatile ( "pushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq" ::: "memory", "cc" );
+}
+
+
+static void record(unsigned int c)
+{
+    got_val[got_count]   = c & 0xFF;
+    got_flags[got_count] = c >> 8;
+    got_when[got_count]  = rx_next;
+    got_count++;
+}
+
+
+/*
+ *  the call under test, single stepped
+ */
+static __attribute__((noinline)) void call(void)
+{
+    unsigned char buf[3];
+    unsigned int  c;
+    unsigned int  n;
+    unsigned int  i;
+
+
+    switch ( op ) {
+    case OP_GET:
+        c = UART_CharGetNonBlocking();
+        if ( !(c & UART_NO_DATA) )
+            record(c);
+        break;
+    case OP_AVAIL:
+        result = UART_CharsAvail();
+        break;
+    case OP_RXFREE:
+        result = UART_RxFree();
+        break;
+    case OP_BLOCKGET1:
+    case OP_BLOCKGET2:
+    case OP_BLOCKGET3:
+        n = UART_BlockGetNonBlocking(buf, op - OP_BLOCKGET1 + 1);
+        for ( i = 0; i < n; i++ )
+            record(buf[i]);
+        break;
+    case OP_FLUSH:
+        UART_FlushBuffer();
+        flush_mark = rx_next;
+        break;
+    case OP_PUT:
+        UART_CharPutNonBlocking((unsigned char)tx_next++);
+        break;
+    case OP_BLOCKPUT1:
+    case OP_BLOCKPUT2:
+    case OP_BLOCKPUT3:
+        for ( i = 0; i < 3; i++ )
+            buf[i] = (unsigned char)(tx_next + i);
+        tx_next += UART_BlockPutNonBlocking(buf, op - OP_BLOCKPUT1 + 1);
+        break;
+    case OP_PENDING:
+        result = UART_TxPending();
+        break;
+    case OP_TXFREE:
+        result = UART_TxFree();
+        break;
+    case OP_ABORT:
+        UART_TxAbort();
+        abort_mark     = tx_next;
+        isr_abort_mark = isr_next;
+        break;
+    }
+}
+
+
+static void traced(void)
+{
+    steps = 0;
+    trace_on();
+    call();
+    trace_off();
+}
+
+
+static void fail(const char *what, unsigned fill, unsigned long at, unsigned burst)
+{
+    if ( failures++ < 20 )
+        printf("FAIL %s: fill %u, %u event(s) at step %lu: %s\n",
+               op_names[op], fill, burst, at, what);
+}
+
+
+/*
+ *  receive side
+ */
+static int check_rx(unsigned fill, unsigned long at, unsigned burst)
+{
+    unsigned i, j, l;
+    unsigned char delivered[MAX_EVENTS];
+
+
+    memset(delivered, 0, sizeof(delivered));
+    for ( i = 0; i < got_count; i++ ) {
+        if ( i && got_val[i] <= got_val[i-1] ) {
+            fail("received characters out of order or repeated", fill, at, burst);
+            return 1;
+        }
+        if ( got_flags[i] & ~(UART_BUFFER_OVERFLOW >> 8) ) {
+            fail("error other than UART_BUFFER_OVERFLOW reported", fill, at, burst);
+            return 1;
+        }
+        delivered[got_val[i]] = 1;
+    }
+
+    for ( l = flush_mark; l < rx_next; l++ ) {
+        if ( delivered[l] )
+            continue;
+        if ( !rx_full_at[l] ) {
+            fail("received character lost without a full ring", fill, at, burst);
+            return 1;
+        }
+        for ( j = 0; j < got_count; j++ )
+            if ( (got_flags[j] & (UART_BUFFER_OVERFLOW >> 8)) && got_when[j] > l )
+                break;
+        if ( j == got_count ) {
+            fail("received character lost without UART_BUFFER_OVERFLOW", fill, at, burst);
+            return 1;
+        }
+    }
+
+    for ( j = 0; j < got_count; j++ ) {
+        if ( !(got_flags[j] & (UART_BUFFER_OVERFLOW >> 8)) )
+            continue;
+        for ( l = 0; l < got_when[j]; l++ )
+            if ( !delivered[l] )
+                break;
+        if ( l == got_when[j] ) {
+            fail("UART_BUFFER_OVERFLOW reported without a lost character", fill, at, burst);
+            return 1;
+        }
+    }
+
+    if ( op == OP_AVAIL || op == OP_RXFREE ) {
+        unsigned level = ( op == OP_AVAIL ) ? (unsigned)result
+                                            : UART_RX_BUFFER_MASK - (unsigned)result;
+        if ( level < level_before || level > level_after ) {
+            fail("receive level the ring never had", fill, at, burst);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int run_rx(unsigned fill, unsigned long at, unsigned burst)
+{
+    unsigned int c;
+    unsigned     i;
+    int          injected;
+
+
+    UART_Init(0);
+    sim_reset();
+    rx_next    = 0;
+    got_count  = 0;
+    flush_mark = 0;
+    inject     = INJECT_RX;
+    for ( i = 0; i < fill; i++ )
+        event();
+
+    level_before = RX_LEVEL();
+    inject_at    = at;
+    inject_count = burst;
+    pending      = 0;
+    progress     = 0;
+    traced();
+    injected  = steps >= at;
+    inject_at = 0;
+    level_after = RX_LEVEL();
+
+    while ( !((c = UART_CharGetNonBlocking()) & UART_NO_DATA) )
+        record(c);
+
+    /* errors are reported with the next character, let one more come */
+    event();
+    while ( !((c = UART_CharGetNonBlocking()) & UART_NO_DATA) )
+        record(c);
+
+    runs++;
+    if ( check_rx(fill, at, burst) )
+        return -1;
+    return injected;
+}
+
+
+/*
+ *  transmit side
+ */
+static int check_tx(unsigned fill, unsigned long at, unsigned burst)
+{
+    unsigned i;
+    unsigned c;
+    int      last_main = -1;
+    int      last_isr  = -1;
+    unsigned char sent[256];
+
+
+    memset(sent, 0, sizeof(sent));
+    for ( i = 0; i < sim_tx_count; i++ ) {
+        c = sim_tx_log[i];
+        if ( c < ISR_BASE ? (c >= tx_next || (int)c <= last_main)
+                          : (c >= isr_next || (int)c <= last_isr) ) {
+            fail("transmitted characters out of order, repeated or invented", fill, at, burst);
+            return 1;
+        }
+        if ( c < ISR_BASE )
+            last_main = c;
+        else
+            last_isr = c;
+        sent[c] = 1;
+    }
+    for ( i = abort_mark; i < tx_next; i++ ) {
+        if ( !sent[i] ) {
+            fail("queued character never transmitted", fill, at, burst);
+            return 1;
+        }
+    }
+    for ( i = isr_abort_mark; i < isr_next; i++ ) {
+        if ( !sent[i] ) {
+            fail("character put by another handler never transmitted", fill, at, burst);
+            return 1;
+        }
+    }
+
+    /* the other handler raises the level, that bound doesn't hold then */
+    if ( (op == OP_PENDING || op == OP_TXFREE) && inject != INJECT_PUT ) {
+        unsigned level = ( op == OP_PENDING ) ? (unsigned)result
+                                              : UART_TX_BUFFER_MASK - (unsigned)result;
+        if ( level > level_before || level < level_after ) {
+            fail("transmit level the ring never had", fill, at, burst);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int run_tx(int kind, unsigned fill, unsigned long at, unsigned burst)
+{
+    unsigned i;
+    int      injected;
+
+
+    UART_Init(0);
+    sim_reset();
+    tx_next        = 0;
+    abort_mark     = 0;
+    isr_next       = ISR_BASE;
+    isr_abort_mark = ISR_BASE;
+    inject         = kind;
+    for ( i = 0; i < fill; i++ )
+        UART_CharPutNonBlocking((unsigned char)tx_next++);
+
+    level_before = TX_LEVEL();
+    inject_at    = at;
+    inject_count = burst;
+    pending      = 0;
+    progress     = 0;
+    traced();
+    injected  = steps >= at;
+    inject_at = 0;
+    level_after = TX_LEVEL();
+
+    for ( i = 0; i < 4 * MAX_EVENTS && (TX_LEVEL() || sim_tx_busy()); i++ )
+        sim_tx_event();
+
+    runs++;
+    if ( check_tx(fill, at, burst) )
+        return -1;
+    return injected;
+}
+
+
+int main(void)
+{
+    struct sigaction sa;
+    unsigned long    at;
+    unsigned         fill;
+    unsigned         burst;
+    int              kind;
+    int              r;
+
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = trap;
+    sa.sa_flags     = SA_SIGINFO;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    for ( op = 0; op < OP_COUNT; op++ ) {
+        unsigned max_fill = ( op < OP_RX_COUNT ) ? UART_RX_BUFFER_SIZE : UART_TX_BUFFER_MASK;
+        for ( kind = INJECT_TX; kind <= INJECT_PUT; kind++ ) {
+            if ( op < OP_RX_COUNT && kind == INJECT_PUT )
+                break;
+            for ( fill = 0; fill <= max_fill; fill++ ) {
+                for ( burst = 1; burst <= 2; burst++ ) {
+                    /* every boundary until the event falls behind the call */
+                    for ( at = 1; ; at++ ) {
+                        r = ( op < OP_RX_COUNT ) ? run_rx(fill, at, burst)
+                                                 : run_tx(kind, fill, at, burst);
+                        if ( r <= 0 )
+                            break;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("interleave: ring sizes %d/%d, %lu runs, %u failures\n",
+           UART_RX_BUFFER_SIZE, UART_TX_BUFFER_SIZE, runs, failures);
+    return failures != 0;
+}
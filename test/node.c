@@ -0,0 +1,200 @@
+/************************************************************************
+Title:    Firmware of a node on the simulated RS-485 bus
+*************************************************************************/
+
+/*
+ *  The master sends each other node in turn a poll, a debug channel frame
+ *  of type 'P' with address and sequence number, and waits for the answer
+ *  of type 'A' with the same two bytes and NODE_DATA more, or a timeout.
+ *  A node answers its address, the last one that of node 1 too if twin is
+ *  set, so that two answers collide. Every node waits the turnaround gap
+ *  after the last character it received before it transmits.
+ */
+#include "config.h"
+#include "sim.h"
+#include "bus.h"
+#include "../uart.h"
+#include "../debug.h"
+
+#define NODE_POLL    'P'
+#define NODE_ANSWER  'A'
+
+/* request and answer in characters, DLE, type, length and check included */
+#define NODE_POLL_CHARS    6
+#define NODE_ANSWER_CHARS  (NODE_POLL_CHARS + NODE_DATA)
+
+static struct node_config node_cfg;
+static unsigned char      node_id;
+static unsigned char      node_de;
+static unsigned long      node_pass;        /* cycles left of a main loop pass */
+static uint64_t           node_heard;       /* last character received */
+
+/* a node's answer waiting for the gap */
+static unsigned char node_reply[2 + NODE_DATA];
+static unsigned char node_replying;
+
+/* the master */
+static struct node_result node_count;
+static unsigned char      node_target;
+static unsigned char      node_seq;
+static unsigned char      node_waiting;
+static unsigned char      node_answered;
+static uint64_t           node_deadline;
+static uint64_t           node_round;
+
+
+/*
+ *  the model reports the transmitter and the driver enable pin to the bus
+ */
+static void node_trace(unsigned what, uint64_t time, uint32_t length, unsigned value)
+{
+    if ( what == SIM_TRACE_TXD )
+        bus_tx(time, length, (uint8_t)value);
+}
+
+
+static void node_watch(void)
+{
+    unsigned char de = (PORTD >> PD2) & 1;
+
+    if ( de != node_de ) {
+        node_de = de;
+        bus_de(sim_now, de);
+    }
+}
+
+
+static void node_poll_frame(const unsigned char *payload, unsigned char len)
+{
+    if ( len != 2 )
+        return;
+    if ( payload[0] == node_id || (node_cfg.twin && node_id == node_cfg.nodes - 1
+                                   && payload[0] == 1) ) {
+        node_reply[0] = payload[0];
+        node_reply[1] = payload[1];
+        node_reply[2] = node_id;
+        node_reply[3] = (unsigned char)sim_now;
+        node_reply[4] = (unsigned char)(sim_now >> 8);
+        node_reply[5] = (unsigned char)(sim_now >> 16);
+        node_replying = 1;
+    }
+}
+
+
+static void node_answer_frame(const unsigned char *payload, unsigned char len)
+{
+    if ( len == 2 + NODE_DATA && payload[0] == node_target && payload[1] == node_seq )
+        node_answered = 1;
+}
+
+
+void node_init(unsigned id, const struct node_config *config)
+{
+    node_cfg = *config;
+    node_id  = (unsigned char)id;
+
+    UART_Init(UART_BAUD_SELECT_DOUBLE_SPEED(node_cfg.baudrate, F_CPU));
+    sim_reset();
+    sim_isr_cycles = node_cfg.isr_cost;
+    sim_trace = node_trace;
+    sim_watch = node_watch;
+
+    if ( node_id == 0 )
+        DEBUG_Register(NODE_ANSWER, node_answer_frame);
+    else
+        DEBUG_Register(NODE_POLL, node_poll_frame);
+}
+
+
+/*
+ *  the master polls the next node once the last one answered or timed out
+ */
+static void node_master(void)
+{
+    unsigned char poll[2];
+    uint32_t      chr = sim_char_cycles();
+
+    if ( node_waiting ) {
+        if ( node_answered )
+            node_count.answers++;
+        else if ( sim_now >= node_deadline )
+            node_count.timeouts++;
+        else
+            return;
+        node_waiting = 0;
+    }
+    if ( sim_now < node_heard + node_cfg.gap )
+        return;
+
+    if ( ++node_target == node_cfg.nodes ) {
+        node_target = 1;
+        if ( node_count.polls ) {
+            node_count.cycles++;
+            node_count.cycle_time += sim_now - node_round;
+        }
+        node_round = sim_now;
+    }
+    poll[0] = node_target;
+    poll[1] = ++node_seq;
+    if ( !DEBUG_Send(NODE_POLL, poll, 2) )
+        return;
+    node_count.polls++;
+    node_waiting  = 1;
+    node_answered = 0;
+    /* the poll, both gaps and the answer, with a margin of four characters */
+    node_deadline = sim_now + (NODE_POLL_CHARS + NODE_ANSWER_CHARS + 4) * chr
+                    + 2 * (node_cfg.gap + node_cfg.work);
+}
+
+
+/*
+ *  one pass of the main loop, it costs node_cfg.work cycles
+ */
+static void node_loop(void)
+{
+    unsigned int c;
+
+    while ( !((c = UART_CharGetNonBlocking()) & UART_NO_DATA) ) {
+        node_heard = sim_now;
+        DEBUG_Input(c);
+    }
+    if ( node_id == 0 )
+        node_master();
+    else if ( node_replying && sim_now >= node_heard + node_cfg.gap
+              && DEBUG_Send(NODE_ANSWER, node_reply, sizeof(node_reply)) )
+        node_replying = 0;
+}
+
+
+int node_run(uint64_t until)
+{
+    uint64_t step;
+
+    while ( sim_now < until ) {
+        if ( node_pass == 0 ) {
+            node_loop();
+            /* the driver enable goes up from the main loop */
+            node_watch();
+            node_pass = node_cfg.work;
+        }
+        step = until - sim_now;
+        if ( step > node_pass )
+            step = node_pass;
+        sim_run(step);
+        node_pass -= step;
+    }
+    return node_id != 0 && !node_replying && !node_de && !sim_rx_queued()
+           && !UART_CharsAvail() && !UART_TxPending() && !sim_tx_busy();
+}
+
+
+void node_rx(uint64_t time, uint8_t data, uint8_t errors)
+{
+    sim_rx_at(time, data, errors);
+}
+
+
+void node_result(struct node_result *result)
+{
+    *result = node_count;
+}
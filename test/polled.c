@@ -0,0 +1,195 @@
+/************************************************************************
+Title:    The library built with UART_POLLED on the USART model
+*************************************************************************/
+
+/*
+ *  Without interrupt handlers the main loop fetches what the receiver
+ *  holds and writes straight to the transmitter. In virtual time the test
+ *  checks that a main loop polling between characters gets them all, that
+ *  one too slow loses only what the receiver can't hold, with the overrun
+ *  reported, that receive errors reach the caller and that output goes out
+ *  back to back and is complete when UART_TxWait() returns. No interrupt
+ *  handler may run.
+ *
+ *  Built for both USART models, see the Makefile.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "sim.h"
+#include "../uart.h"
+
+#ifndef UART_POLLED
+#error "polled.c tests the library built with UART_POLLED"
+#endif
+
+#define BAUDRATE  115200UL
+#define PASS      50               /* cycles per main loop pass */
+
+static unsigned failures;
+static unsigned interrupts;
+
+
+static void check(int ok, const char *what)
+{
+    if ( !ok ) {
+        failures++;
+        printf("FAIL %s\n", what);
+    }
+}
+
+
+static void trace(unsigned what, uint64_t time, uint32_t length, unsigned value)
+{
+    (void)time; (void)length; (void)value;
+    if ( what == SIM_TRACE_RX || what == SIM_TRACE_UDRE || what == SIM_TRACE_TXC )
+        interrupts++;
+}
+
+
+/*
+ *  a status poll costs the cycles of the loop around it
+ */
+static void poll(void)
+{
+    sim_run(4);
+}
+
+
+static void start(void)
+{
+    UART_Init(UART_BAUD_SELECT(BAUDRATE, F_CPU));
+    sim_reset();
+    sim_line(BAUDRATE);
+}
+
+
+/*
+ *  receive until all characters scheduled have arrived and been fetched,
+ *  the main loop polling every pass cycles
+ */
+static unsigned receive(unsigned *buf, unsigned size, uint64_t pass)
+{
+    unsigned n = 0, c;
+
+    for (;;) {
+        c = UART_CharGetNonBlocking();
+        if ( c & UART_NO_DATA ) {
+            if ( !sim_rx_queued() )
+                return n;
+            sim_run(pass);
+            continue;
+        }
+        if ( n < size )
+            buf[n] = c;
+        n++;
+    }
+}
+
+
+static void test_receive(void)
+{
+    static const char text[] = "polled receive\r\n";
+    unsigned          got[sizeof(text)];
+    unsigned          i, n;
+
+    start();
+    for ( i = 0; i < sizeof(text) - 1; i++ )
+        sim_rx_send((uint8_t)text[i], 0);
+    n = receive(got, sizeof(got), PASS);
+    check(n == sizeof(text) - 1, "every character fetched by a fast main loop");
+    for ( i = 0; i < n && i < sizeof(text) - 1; i++ )
+        check(got[i] == (unsigned char)text[i], "characters in order without errors");
+}
+
+
+/*
+ *  the receiver holds two characters and a third in the shift register,
+ *  the fourth to complete overwrites that one
+ */
+static void test_overrun(void)
+{
+    unsigned got[4];
+    unsigned n;
+
+    start();
+    sim_rx_send('a', 0);
+    sim_rx_send('b', 0);
+    sim_rx_send('c', 0);
+    n = receive(got, 4, 4 * sim_char_cycles());
+    check(n == 3 && got[0] == 'a' && got[1] == 'b' && got[2] == 'c',
+          "three characters survive a main loop pass of four character times");
+
+    start();
+    sim_rx_send('a', 0);
+    sim_rx_send('b', 0);
+    sim_rx_send('c', 0);
+    sim_rx_send('d', 0);
+    n = receive(got, 4, 5 * sim_char_cycles());
+    check(n == 3 && (got[0] & 0xFF) == 'a' && got[1] == 'b' && got[2] == 'd',
+          "the fourth character overwrites the third");
+    /* the errors stick until the next call, which gets the oldest one */
+    check(n == 3 && got[0] == (UART_OVERRUN_ERROR | 'a'),
+          "the call after the loss reports UART_OVERRUN_ERROR");
+}
+
+
+static void test_errors(void)
+{
+    start();
+    sim_rx_frame('x', SIM_FE);
+    check(UART_CharGetNonBlocking() == (UART_FRAME_ERROR | 'x'),
+          "missing stop bit gives UART_FRAME_ERROR");
+    sim_rx_frame('y', SIM_PE);
+    check(UART_CharGetNonBlocking() == (UART_PARITY_ERROR | 'y'),
+          "parity error gives UART_PARITY_ERROR");
+    sim_rx_break();
+    check(UART_CharGetNonBlocking() == (UART_BREAK | UART_FRAME_ERROR),
+          "break gives UART_BREAK");
+    check(UART_CharGetNonBlocking() == UART_NO_DATA, "nothing else received");
+}
+
+
+static void test_transmit(void)
+{
+    static const char text[] = "polled transmit, straight to the data register\r\n";
+    uint64_t          t0;
+    unsigned          chr;
+
+    start();
+    chr = sim_char_cycles();
+    t0  = sim_now;
+    sim_poll = poll;
+    UART_StringPutNonBlocking(text);
+    check(UART_TxWait(0) == 0, "UART_TxWait() completes");
+    sim_poll = NULL;
+
+    check(sim_tx_count == sizeof(text) - 1
+          && memcmp(sim_tx_log, text, sizeof(text) - 1) == 0,
+          "the whole string went out in order");
+    check(sim_tx_busy() == 0, "the transmitter is empty when UART_TxWait() returns");
+    check(UART_TxPending() == 0, "nothing left in the ringbuffer");
+    /* back to back, a poll or two late at most */
+    check(sim_now - t0 < (sizeof(text) - 1) * chr + 2 * chr,
+          "characters sent back to back");
+}
+
+
+int main(void)
+{
+    sim_trace = trace;
+
+    test_receive();
+    test_overrun();
+    test_errors();
+    test_transmit();
+    check(interrupts == 0, "no interrupt handler ran");
+
+#ifdef UART_MODERN_USART
+    printf("polled: newer USART, %u failures\n", failures);
+#else
+    printf("polled: classic USART, %u failures\n", failures);
+#endif
+    return failures != 0;
+}
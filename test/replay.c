@@ -0,0 +1,361 @@
+/************************************************************************
+Title:    Replay of captured serial traffic into the receive interrupt
+*************************************************************************/
+
+/*
+ *  A capture is a text file with one character per line,
+ *
+ *      <time in us> rx|tx <data in hex> [BRK] [FE] [DOR] [PE] [OVF]
+ *
+ *  the flags being the receive errors UART_CAPTURE records with a
+ *  character, e.g. "1321.3 rx 00 BRK FE"; lines starting with # are
+ *  comments. With -k the input is a dump of UART_Capture records as the
+ *  device reads them with UART_CaptureGet() instead, four bytes each:
+ *  time low and high byte, flags, data, the time counting timer ticks of
+ *  the given us. Gaps of a whole timer period can't be told from none.
+ *
+ *  The received characters arrive through the USART model at their
+ *  original times, or -x times faster but never faster than the line
+ *  carries them at -b baud, and run the real receive interrupt. The main
+ *  loop feeds them through the debug channel, which answers every frame of
+ *  the types given with -t with an echo of type 'E'. From the arrival of a
+ *  frame's last character to its handler is the latency of the frame, the
+ *  replay prints its distribution:
+ *
+ *      replay -x 4 -e 100 captures/ping.cap
+ *
+ *  The library is built with UART_CAPTURE on a timer of F_CPU/64, -o
+ *  writes what it records in both directions in the capture format, as
+ *  the sniffer of a device would. Exit code 1 if characters were lost or
+ *  the number of frames handled differs from -e.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+/* a 16 bit timer with prescaler 64 time stamps the capture records */
+#define CAPTURE_PRESCALE    64
+#define UART_CAPTURE
+#define UART_CAPTURE_SIZE   64
+#define UART_CAPTURE_TIME() ((unsigned int)(uint16_t)(sim_now / CAPTURE_PRESCALE))
+
+#include "../uart.c"
+#include "../debug.h"
+
+/* scheduled ahead of the virtual time */
+#define REPLAY_AHEAD  1024
+
+#define US(c)     ((c) * 1000000.0 / F_CPU)
+#define CYCLES(u) ((u) * (F_CPU / 1000000.0))
+
+/* settings, see usage() */
+static unsigned long baudrate = 115200;
+static double        speedup  = 1.0;
+static unsigned long work     = 400;
+static unsigned long per_char = 60;
+static unsigned      isr_cost = 60;
+static const char   *types    = "Z";
+static long          expect   = -1;
+static double        tick_us;
+static const char   *sniff_name;
+
+/* the capture */
+static struct record {
+    double  us;
+    uint8_t tx;
+    uint8_t flags;
+    uint8_t data;
+} *records;
+static size_t records_count;
+
+/* flag names, the high byte of the UART_CharGetNonBlocking() errors */
+static const struct {
+    const char *name;
+    uint8_t     flag;
+} flag_names[] = {
+    { "BRK", UART_BREAK >> 8 },
+    { "FE",  UART_FRAME_ERROR >> 8 },
+    { "DOR", UART_OVERRUN_ERROR >> 8 },
+    { "PE",  UART_PARITY_ERROR >> 8 },
+    { "OVF", UART_BUFFER_OVERFLOW >> 8 },
+};
+#define FLAG_NAMES (sizeof(flag_names) / sizeof(flag_names[0]))
+
+/* arrival of each received character scheduled, in order */
+static uint64_t *arrival;
+static size_t    scheduled, consumed;
+static uint64_t  last_arrival;
+
+static double   *latency;
+static size_t    frames;
+static unsigned  unanswered;
+
+static FILE     *sniff;
+static uint64_t  sniff_ticks;
+
+
+static void add_record(double us, uint8_t tx, uint8_t flags, uint8_t data)
+{
+    static size_t room;
+
+    if ( records_count == room ) {
+        room = room ? 2 * room : 4096;
+        records = realloc(records, room * sizeof(*records));
+        if ( !records ) {
+            perror("replay");
+            exit(2);
+        }
+    }
+    records[records_count].us    = us;
+    records[records_count].tx    = tx;
+    records[records_count].flags = flags;
+    records[records_count].data  = data;
+    records_count++;
+}
+
+
+static int load_text(FILE *f, const char *name)
+{
+    char     line[256];
+    char     dir[8];
+    char    *tok;
+    double   us;
+    unsigned data, i, n = 0;
+    uint8_t  flags;
+
+    while ( fgets(line, sizeof(line), f) ) {
+        n++;
+        if ( line[0] == '#' || line[strspn(line, " \t\r\n")] == 0 )
+            continue;
+        if ( sscanf(line, "%lf %7s %x", &us, dir, &data) != 3
+             || (strcmp(dir, "rx") && strcmp(dir, "tx")) || data > 0xFF ) {
+            fprintf(stderr, "%s:%u: not a capture record\n", name, n);
+            return -1;
+        }
+        /* the flags follow the three fields */
+        flags = 0;
+        tok = strtok(line, " \t\r\n");
+        for ( i = 0; tok && i < 3; i++ )
+            tok = strtok(NULL, " \t\r\n");
+        for ( ; tok; tok = strtok(NULL, " \t\r\n") ) {
+            for ( i = 0; i < FLAG_NAMES && strcmp(tok, flag_names[i].name); i++ )
+                ;
+            if ( i == FLAG_NAMES ) {
+                fprintf(stderr, "%s:%u: unknown flag %s\n", name, n, tok);
+                return -1;
+            }
+            flags |= flag_names[i].flag;
+        }
+        add_record(us, dir[0] == 't', flags, (uint8_t)data);
+    }
+    return 0;
+}
+
+
+static int load_dump(FILE *f)
+{
+    uint8_t  rec[4];
+    uint16_t time;
+    uint64_t ticks = 0;
+    int      first = 1;
+
+    while ( fread(rec, sizeof(rec), 1, f) == 1 ) {
+        time = rec[0] | rec[1] << 8;
+        /* the timer wraps, records come in order */
+        ticks = first ? time : ticks + (uint16_t)(time - (uint16_t)ticks);
+        first = 0;
+        add_record(ticks * tick_us, (rec[2] & (UART_CAPTURE_TX >> 8)) != 0,
+                   rec[2] & ~(UART_CAPTURE_TX >> 8), rec[3]);
+    }
+    return 0;
+}
+
+
+static void write_record(FILE *f, double us, uint8_t flags, uint8_t data)
+{
+    unsigned i;
+
+    fprintf(f, "%.1f %s %02x", us, (flags & (UART_CAPTURE_TX >> 8)) ? "tx" : "rx", data);
+    for ( i = 0; i < FLAG_NAMES; i++ )
+        if ( !(flags & (UART_CAPTURE_TX >> 8)) && (flags & flag_names[i].flag) )
+            fprintf(f, " %s", flag_names[i].name);
+    fputc('\n', f);
+}
+
+
+/*
+ *  the sniffer: what the library captured, fetched like the device would
+ */
+static void sniff_drain(void)
+{
+    UART_Capture rec;
+    unsigned     lost;
+
+    while ( UART_CaptureGet(&rec) ) {
+        sniff_ticks += (uint16_t)(rec.time - (uint16_t)sniff_ticks);
+        if ( sniff )
+            write_record(sniff, US(sniff_ticks * CAPTURE_PRESCALE), rec.flags, rec.data);
+    }
+    lost = UART_CaptureLost();
+    if ( lost && sniff )
+        fprintf(sniff, "# %u records lost\n", lost);
+}
+
+
+/*
+ *  the firmware logic: frames of the types given are answered with an echo
+ */
+static void handler(const unsigned char *payload, unsigned char len)
+{
+    latency[frames++] = US((double)(sim_now - last_arrival));
+    if ( !DEBUG_Send('E', payload, len) )
+        unanswered++;
+}
+
+
+static void poll(void)
+{
+    sim_run(4);
+}
+
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-b baud] [-x speedup] [-w cycles per main loop pass]\n"
+        "          [-c cycles per character] [-i cycles per interrupt]\n"
+        "          [-t frame types] [-e frames expected] [-o sniffed.cap]\n"
+        "          [-k us per tick of a binary dump] capture\n", name);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    FILE         *f;
+    size_t        next = 0, i;
+    uint64_t      t, start, line_free;
+    double        base = 0, line_char;
+    unsigned long overflows = 0;
+    unsigned int  c;
+    uint8_t       errors;
+    int           opt, status;
+
+
+    while ( (opt = getopt(argc, argv, "b:x:w:c:i:t:e:o:k:")) != -1 ) {
+        switch ( opt ) {
+        case 'b': baudrate   = strtoul(optarg, NULL, 0); break;
+        case 'x': speedup    = strtod(optarg, NULL); break;
+        case 'w': work       = strtoul(optarg, NULL, 0); break;
+        case 'c': per_char   = strtoul(optarg, NULL, 0); break;
+        case 'i': isr_cost   = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 't': types      = optarg; break;
+        case 'e': expect     = strtol(optarg, NULL, 0); break;
+        case 'o': sniff_name = optarg; break;
+        case 'k': tick_us    = strtod(optarg, NULL); break;
+        default:  usage(argv[0]);
+        }
+    }
+    if ( optind != argc - 1 || speedup <= 0 )
+        usage(argv[0]);
+
+    f = strcmp(argv[optind], "-") ? fopen(argv[optind], tick_us ? "rb" : "r") : stdin;
+    if ( !f ) {
+        perror(argv[optind]);
+        return 2;
+    }
+    status = tick_us ? load_dump(f) : load_text(f, argv[optind]);
+    fclose(f);
+    if ( status )
+        return 2;
+    if ( sniff_name ) {
+        sniff = fopen(sniff_name, "w");
+        if ( !sniff ) {
+            perror(sniff_name);
+            return 2;
+        }
+        fprintf(sniff, "# replay of %s, %gx\n", argv[optind], speedup);
+    }
+    arrival = malloc((records_count + 1) * sizeof(*arrival));
+    latency = malloc((records_count + 1) * sizeof(*latency));
+    if ( !arrival || !latency ) {
+        perror("replay");
+        return 2;
+    }
+
+    UART_Init(UART_BAUD_SELECT_DOUBLE_SPEED(baudrate, F_CPU));
+    sim_reset();
+    sim_isr_cycles = isr_cost;
+    sim_poll = poll;
+    sim_line(baudrate);
+    sniff_ticks = UART_CAPTURE_TIME();
+    for ( i = 0; types[i]; i++ )
+        if ( DEBUG_Register((unsigned char)types[i], handler) ) {
+            fprintf(stderr, "replay: more than %d frame types\n", DEBUG_HANDLERS);
+            return 2;
+        }
+
+    /* the first received character arrives a character time from now */
+    line_char = F_CPU * 10.0 / baudrate;
+    start     = sim_now;
+    line_free = sim_now;
+    for ( i = 0; i < records_count && records[i].tx; i++ )
+        ;
+    if ( i < records_count && records[i].us > 0 )
+        base = records[i].us;
+
+    while ( next < records_count || sim_rx_queued() || UART_CharsAvail() ) {
+        /* schedule what is due soon, the line can't go faster than the baud rate */
+        for ( ; next < records_count && sim_rx_queued() < REPLAY_AHEAD; next++ ) {
+            if ( records[next].tx )
+                continue;
+            t = start + (uint64_t)CYCLES((records[next].us - base) / speedup);
+            if ( t < line_free + (uint64_t)line_char )
+                t = line_free + (uint64_t)line_char;
+            line_free = t;
+            errors  = (records[next].flags & (UART_FRAME_ERROR >> 8)) ? SIM_FE : 0;
+            errors |= (records[next].flags & (UART_PARITY_ERROR >> 8)) ? SIM_PE : 0;
+            errors |= (records[next].flags & (UART_OVERRUN_ERROR >> 8)) ? SIM_DOR : 0;
+            sim_rx_at(t, records[next].data, errors);
+            arrival[scheduled++] = t;
+        }
+
+        sim_run(work);
+        while ( !((c = UART_CharGetNonBlocking()) & UART_NO_DATA) ) {
+            if ( c & UART_BUFFER_OVERFLOW )
+                overflows++;
+            if ( consumed < scheduled )
+                last_arrival = arrival[consumed++];
+            sim_run(per_char);
+            DEBUG_Input(c);
+        }
+        sniff_drain();
+    }
+    while ( UART_TxPending() || sim_tx_busy() ) {
+        sim_run(work);
+        sniff_drain();
+    }
+
+    qsort(latency, frames, sizeof(*latency), compare);
+    printf("replay: %zu records, %zu received, %gx, %zu frames handled, %u unanswered, "
+           "%zu lost%s\n", records_count, scheduled, speedup, frames, unanswered,
+           scheduled - consumed, overflows ? " (UART_BUFFER_OVERFLOW)" : "");
+    if ( frames )
+        printf("replay: frame latency min %.1f us, median %.1f us, 99%% %.1f us, max %.1f us\n",
+               latency[0], latency[frames / 2], latency[frames * 99 / 100], latency[frames - 1]);
+
+    if ( sniff )
+        fclose(sniff);
+    return scheduled != consumed || (expect >= 0 && (long)frames != expect);
+}
@@ -0,0 +1,230 @@
+/************************************************************************
+Title:    Page upload against a sender model on the USART model
+*************************************************************************/
+
+/*
+ *  The sender streams a firmware image the way the host tool does: it
+ *  waits for the device to ask for the first page, keeps up to UPLOAD_WINDOW pages ahead of the last ACK on the line,
+ *  goes back to the page named in a NAK and ends with EOT once every page
+ *  is acknowledged. The device runs UPLOAD_Poll() in a main loop in
+ *  virtual time, with a timer tick every millisecond, and its commit
+ *  callback only starts the page write, UPLOAD_Committed() follows when
+ *  the write time is over.
+ *
+ *  For a fast and a slow flash and a page damaged on the line the test
+ *  checks that the transfer ends with UPLOAD_DONE and the sender sees
+ *  EOT, that the pages are committed once each and in order, one write at
+ *  a time, that the flash holds the image and that the sender never had
+ *  more than UPLOAD_WINDOW pages unacknowledged, but did use the window.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "config.h"
+#include "sim.h"
+#include "../uart.h"
+#include "../upload.h"
+
+#define BAUDRATE   500000UL
+#define PAGES      24
+#define PASS       200                      /* cycles per main loop pass */
+#define TICK       (F_CPU / 1000)           /* timer interrupt period    */
+
+#define STX  0x02
+#define EOT  0x04
+#define ACK  0x06
+#define NAK  0x15
+#define CAN  0x18
+
+static unsigned failures;
+
+static unsigned char image[PAGES * UPLOAD_PAGE_SIZE];
+static unsigned char flash[PAGES * UPLOAD_PAGE_SIZE];
+
+/* the device's flash writes */
+static uint64_t      write_cycles;
+static uint64_t      write_done;
+static int           writing;
+static unsigned      committed[PAGES + 1];
+static unsigned      commit_count;
+static int           overlap;
+
+/* the sender */
+static struct {
+    unsigned next;          /* page to send next                   */
+    unsigned acked;         /* pages acknowledged in sequence      */
+    unsigned window;        /* most pages unacknowledged at a time */
+    unsigned damage;        /* page to damage on its first sending */
+    unsigned naks;
+    unsigned consumed;      /* device output read so far           */
+    unsigned char answer;   /* first byte of a two byte answer     */
+    int      started;       /* the device asked for the first page */
+    int      eot_sent;
+    int      eot_seen;
+    int      cancelled;
+} tx;
+
+
+static void check(int ok, const char *what)
+{
+    if ( !ok ) {
+        failures++;
+        printf("FAIL %s\n", what);
+    }
+}
+
+
+/*
+ *  the commit callback starts the write, the main loop finishes it
+ */
+static void commit(unsigned int page, const unsigned char *data)
+{
+    if ( writing )
+        overlap = 1;
+    if ( commit_count <= PAGES )
+        committed[commit_count++] = page;
+    if ( page < PAGES )
+        memcpy(flash + page * UPLOAD_PAGE_SIZE, data, UPLOAD_PAGE_SIZE);
+    writing    = 1;
+    write_done = sim_now + write_cycles;
+}
+
+
+static void send_page(unsigned page)
+{
+    const unsigned char *p = image + page * UPLOAD_PAGE_SIZE;
+    uint16_t crc = 0;
+    unsigned i;
+
+    sim_rx_send(STX, 0);
+    sim_rx_send((uint8_t)page, 0);
+    sim_rx_send((uint8_t)~page, 0);
+    for ( i = 0; i < UPLOAD_PAGE_SIZE; i++ ) {
+        crc = _crc_xmodem_update(crc, p[i]);
+        /* a bit flipped on the line */
+        sim_rx_send(p[i] ^ (page == tx.damage && i == 7 ? 0x10 : 0), 0);
+    }
+    if ( page == tx.damage )
+        tx.damage = PAGES;
+    sim_rx_send((uint8_t)(crc >> 8), 0);
+    sim_rx_send((uint8_t)crc, 0);
+}
+
+
+/*
+ *  the sender reads what the device sent and keeps the window full
+ */
+static void sender(void)
+{
+    unsigned char c;
+    unsigned      page;
+
+    while ( tx.consumed < sim_tx_count ) {
+        c = sim_tx_log[tx.consumed++];
+        if ( !tx.answer ) {
+            if ( c == EOT )
+                tx.eot_seen = 1;
+            else if ( c == ACK || c == NAK || c == CAN )
+                tx.answer = c;
+            continue;
+        }
+        /* the page number modulo 256 of an ACK or NAK near the window */
+        page = tx.acked + (unsigned char)(c - tx.acked);
+        if ( tx.answer == NAK && !tx.started ) {
+            tx.started = 1;
+        }else if ( tx.answer == ACK && page == tx.acked && page < tx.next ) {
+            tx.acked++;
+        }else if ( tx.answer == NAK && page >= tx.acked && page < tx.next ) {
+            /* the device drops what is still on the line until then */
+            tx.naks++;
+            tx.next = page;
+        }else if ( tx.answer == CAN ) {
+            tx.cancelled = 1;
+        }
+        tx.answer = 0;
+    }
+
+    while ( tx.started && tx.next < PAGES && tx.next - tx.acked < UPLOAD_WINDOW )
+        send_page(tx.next++);
+    if ( tx.next - tx.acked > tx.window )
+        tx.window = tx.next - tx.acked;
+
+    if ( tx.acked == PAGES && !tx.eot_sent ) {
+        sim_rx_send(EOT, 0);
+        sim_rx_send((uint8_t)~EOT, 0);
+        tx.eot_sent = 1;
+    }
+}
+
+
+static void run(const char *name, uint64_t write_us, unsigned damage)
+{
+    unsigned char status = UPLOAD_BUSY;
+    uint64_t      start = sim_now, tick = sim_now + TICK, limit;
+    unsigned      i;
+    int           ordered = 1;
+
+    UART_Init(UART_BAUD_SELECT_DOUBLE_SPEED(BAUDRATE, F_CPU));
+    sim_reset();
+    sim_line(BAUDRATE);
+    UPLOAD_Init(commit);
+    memset(flash, 0xFF, sizeof(flash));
+    memset(&tx, 0, sizeof(tx));
+    tx.damage    = damage;
+    write_cycles = write_us * (F_CPU / 1000000);
+    writing      = 0;
+    commit_count = 0;
+    overlap      = 0;
+
+    /* the whole image at the line rate plus every write, twice over */
+    limit = start + 2 * (PAGES * (UPLOAD_PAGE_SIZE + 7) * (uint64_t)sim_char_cycles()
+                           + PAGES * write_cycles) + F_CPU / 10;
+    while ( status == UPLOAD_BUSY && sim_now < limit ) {
+        status = UPLOAD_Poll();
+        if ( writing && sim_now >= write_done ) {
+            writing = 0;
+            UPLOAD_Committed();
+        }
+        sim_run(PASS);
+        if ( sim_now >= tick ) {
+            tick += TICK;
+            UPLOAD_Tick();
+        }
+        sender();
+    }
+    /* the EOT on its way */
+    sim_run(4 * sim_char_cycles());
+    sender();
+
+    for ( i = 0; i < commit_count; i++ )
+        if ( committed[i] != i )
+            ordered = 0;
+    check(status == UPLOAD_DONE, "the transfer ends with UPLOAD_DONE");
+    check(tx.eot_seen && !tx.cancelled, "the sender sees EOT");
+    check(commit_count == PAGES && ordered, "every page committed once, in order");
+    check(!overlap, "one page write at a time");
+    check(memcmp(flash, image, sizeof(image)) == 0, "the flash holds the image");
+    check(tx.window <= UPLOAD_WINDOW, "no more than UPLOAD_WINDOW pages unacknowledged");
+    check(tx.window == UPLOAD_WINDOW, "the sender used the whole window");
+    check(damage < PAGES ? tx.naks >= 1 : tx.naks == 0, "a NAK for the damaged page only");
+
+    printf("sender: %s, %u pages of %u bytes in %.1f ms, %u NAKs\n", name, PAGES,
+           UPLOAD_PAGE_SIZE, (sim_now - start) * 1000.0 / F_CPU, tx.naks);
+}
+
+
+int main(void)
+{
+    unsigned i;
+
+    for ( i = 0; i < sizeof(image); i++ )
+        image[i] = (unsigned char)(i * 7 + (i >> 8));
+
+    run("fast flash", 500, PAGES);
+    run("slow flash", 4500, PAGES);
+    run("damaged page", 4500, 5);
+
+    printf("sender: %u failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "sim.h"
+
+/*
+ *  registers
+ */
+volatile uint8_t sim_sreg;
+volatile uint8_t sim_portd, sim_ddrd;
+
+/* the status flags and the interrupt enables are at the same positions
+   in both USARTs */
+#define SIM_RXC    7
+#define SIM_TXC    6
+#define SIM_UDRE   5
+
+#ifdef USART_DREIF_bm
+/* the newer USART: flags in STATUS, errors in RXDATAH, the interrupt
+   enables in CTRLA, CLK2X in CTRLB */
+static USART_t sim_usart0;
+#define SIM_ENABLES  sim_usart0.CTRLA
+#define SIM_RXEN     (sim_usart0.CTRLB & USART_RXEN_bm)
+#define SIM_MSPIM    ((sim_usart0.CTRLC & USART_CMODE_MSPI_gc) == USART_CMODE_MSPI_gc)
+#else
+volatile uint8_t sim_ucsr0a, sim_ucsr0b, sim_ucsr0c;
+volatile uint8_t sim_ubrr0h, sim_ubrr0l, sim_prr;
+volatile uint8_t sim_udr0;
+#define SIM_ENABLES  sim_ucsr0b
+#define SIM_RXEN     (sim_ucsr0b & (1<<RXEN0))
+#define SIM_MSPIM    (((sim_ucsr0c >> UMSEL00) & 3) == 3)
+#endif
+
+/* interrupt handlers of the library, none with UART_POLLED */
+extern void sim_vect_rx(void) __attribute__((weak));
+extern void sim_vect_udre(void) __attribute__((weak));
+extern void sim_vect_tx(void) __attribute__((weak));
+
+uint8_t  sim_tx_log[SIM_TX_LOG];
+unsigned sim_tx_count;
+void   (*sim_poll)(void);
+uint8_t (*sim_miso)(uint8_t mosi);
+
+/* virtual time */
+uint64_t sim_now;
+unsigned sim_isr_cycles;
+void   (*sim_watch)(void);
+void   (*sim_trace)(unsigned what, uint64_t time, uint32_t length, unsigned value);
+
+static uint8_t  sim_rx_fifo[2];
+static uint8_t  sim_rx_err[2];      /* SIM_FE, SIM_PE and SIM_DOR per entry */
+static unsigned sim_rx_level;
+static unsigned sim_rx_held;        /* a character waits in the shift register */
+static uint8_t  sim_rx_shift;
+static uint8_t  sim_rx_shift_err;
+static uint8_t  sim_tx_fifo[2];     /* [0] shifting, [1] waiting in UDR */
+static unsigned sim_tx_level;
+static unsigned sim_tx_open;        /* a write to UDR is under way */
+static uint8_t  sim_tx_slot;
+static unsigned sim_txc;
+static uint64_t sim_tx_done;        /* the shifting character is out */
+static uint8_t  sim_flags;          /* RXC, TXC and UDRE */
+
+/* characters on their way in, by the time their stop bit completes */
+static struct {
+    uint64_t time;
+    uint8_t  data;
+    uint8_t  errors;
+} sim_rxq[SIM_RX_QUEUE];
+static unsigned sim_rxq_head, sim_rxq_tail;
+static double   sim_line_char;      /* sender's character time, cycles */
+static double   sim_line_free;      /* its line is idle from then */
+
+
+/*
+ *  derive the status flags from the model; FE, DOR and UPE belong to the
+ *  character at the head of the FIFO
+ */
+static void sim_status(void)
+{
+    uint8_t a = 0, e = 0;
+
+    if ( sim_rx_level ) {
+        a |= 1<<SIM_RXC;
+        e  = sim_rx_err[0];
+    }
+    if ( sim_tx_level + sim_tx_open < 2 )
+        a |= 1<<SIM_UDRE;
+    if ( sim_txc )
+        a |= 1<<SIM_TXC;
+    sim_flags = a;
+
+#ifdef USART_DREIF_bm
+    sim_usart0.STATUS  = a;
+    sim_usart0.RXDATAH = (a & (1<<SIM_RXC))
+                         | ((e & SIM_FE) ? USART_FERR_bm : 0)
+                         | ((e & SIM_PE) ? USART_PERR_bm : 0)
+                         | ((e & SIM_DOR) ? USART_BUFOVF_bm : 0);
+#else
+    /* U2X and MPCM are the program's */
+    sim_ucsr0a = (sim_ucsr0a & ((1<<U2X0)|(1<<MPCM0))) | a
+                 | ((e & SIM_FE) ? 1<<FE0 : 0)
+                 | ((e & SIM_PE) ? 1<<UPE0 : 0)
+                 | ((e & SIM_DOR) ? 1<<DOR0 : 0);
+#endif
+}
+
+
+/*
+ *  the value of the last UDR write is in the slot once the program has
+ *  gone on to its next access
+ */
+static void sim_tx_commit(void)
+{
+    if ( !sim_tx_open )
+        return;
+    sim_tx_open = 0;
+    sim_tx_fifo[sim_tx_level++] = sim_tx_slot;
+    sim_txc = 0;
+    /* an idle transmitter moves it to the shift register right away */
+    if ( sim_tx_level == 1 ) {
+        sim_tx_done = sim_now + sim_char_cycles();
+        if ( sim_trace )
+            sim_trace(SIM_TRACE_TXD, sim_now, sim_char_cycles(), sim_tx_slot);
+    }
+}
+
+
+/*
+ *  UCSR0A as the program sees it, or all of USART0 of the newer USART
+ */
+static void sim_access(void)
+{
+    sim_tx_commit();
+    sim_status();
+    if ( sim_poll )
+        sim_poll();
+}
+
+
+#ifdef USART_DREIF_bm
+USART_t *sim_usart(void)
+{
+    sim_access();
+    return &sim_usart0;
+}
+#else
+volatile uint8_t *sim_status_reg(void)
+{
+    sim_access();
+    return &sim_ucsr0a;
+}
+#endif
+
+
+/*
+ *  run an interrupt handler with the I flag cleared, as the CPU does
+ */
+static void sim_interrupt(void (*vector)(void), unsigned what)
+{
+    uint8_t sreg = sim_sreg;
+
+    if ( sim_trace )
+        sim_trace(what, sim_now, sim_isr_cycles, 0);
+    sim_sreg &= ~(1<<SREG_I);
+    vector();
+    sim_tx_commit();
+    sim_status();
+    sim_now += sim_isr_cycles;
+    sim_sreg = sreg;
+}
+
+
+/*
+ *  run the interrupts that are flagged and enabled, in the priority order
+ *  of the vector table, until none is left
+ */
+static void sim_pending(void)
+{
+    unsigned n;
+
+    for ( n = 0; ; n++ ) {
+        if ( !(sim_sreg & (1<<SREG_I)) )
+            return;
+        if ( n == 1000 ) {
+            fprintf(stderr, "sim: interrupt flag never cleared\n");
+            abort();
+        }
+        sim_tx_commit();
+        sim_status();
+        if ( (SIM_ENABLES & (1<<SIM_RXC)) && sim_rx_level && sim_vect_rx )
+            sim_interrupt(sim_vect_rx, SIM_TRACE_RX);
+        else if ( (SIM_ENABLES & (1<<SIM_UDRE)) && (sim_flags & (1<<SIM_UDRE)) && sim_vect_udre )
+            sim_interrupt(sim_vect_udre, SIM_TRACE_UDRE);
+        else if ( (SIM_ENABLES & (1<<SIM_TXC)) && sim_txc && sim_vect_tx ) {
+            /* entering the vector clears TXC */
+            sim_txc = 0;
+            sim_interrupt(sim_vect_tx, SIM_TRACE_TXC);
+        }else
+            return;
+    }
+}
+
+
+uint8_t sim_rx_data(void)
+{
+    uint8_t data = sim_rx_fifo[0];
+
+    if ( sim_rx_level == 0 ) {
+        fprintf(stderr, "sim: UDR0 read with empty receive FIFO\n");
+        abort();
+    }
+    sim_rx_fifo[0] = sim_rx_fifo[1];
+    sim_rx_err[0]  = sim_rx_err[1];
+    sim_rx_level--;
+    /* a character held in the shift register moves up */
+    if ( sim_rx_held ) {
+        sim_rx_held = 0;
+        sim_rx_fifo[sim_rx_level] = sim_rx_shift;
+        sim_rx_err[sim_rx_level]  = sim_rx_shift_err;
+        sim_rx_level++;
+    }
+    sim_status();
+    return data;
+}
+
+
+uint8_t *sim_tx_data(void)
+{
+    sim_tx_commit();
+    if ( sim_tx_level >= 2 ) {
+        fprintf(stderr, "sim: UDR0 written while UDRE was clear\n");
+        abort();
+    }
+    sim_tx_open = 1;
+    sim_status();
+    return &sim_tx_slot;
+}
+
+
+void sim_txc_clear(void)
+{
+    sim_tx_commit();
+    sim_txc = 0;
+    sim_status();
+}
+
+
+void sim_reset(void)
+{
+    sim_rxq_head = sim_rxq_tail = 0;
+    sim_line_free = sim_now;
+    sim_rx_level = 0;
+    sim_rx_held  = 0;
+    sim_tx_level = 0;
+    sim_tx_open  = 0;
+    sim_txc      = 0;
+    sim_tx_count = 0;
+    sim_sreg |= 1<<SREG_I;
+    sim_status();
+}
+
+
+/*
+ *  a character completes in the receiver
+ */
+static void sim_rx_complete(uint8_t data, uint8_t errors)
+{
+    if ( sim_rx_level < 2 ) {
+        sim_rx_fifo[sim_rx_level] = data;
+        sim_rx_err[sim_rx_level]  = errors;
+        sim_rx_level++;
+    }else if ( sim_rx_held ) {
+        /* a start bit with both FIFO levels and the shift register full:
+           the held character is lost, the next one read flags DOR */
+        sim_rx_shift     = data;
+        sim_rx_shift_err = errors | SIM_DOR;
+    }else{
+        sim_rx_held      = 1;
+        sim_rx_shift     = data;
+        sim_rx_shift_err = errors;
+    }
+}
+
+
+void sim_rx_frame(uint8_t data, uint8_t errors)
+{
+    sim_rx_complete(data, errors);
+    sim_status();
+    sim_pending();
+}
+
+
+void sim_rx_event(uint8_t data)
+{
+    sim_rx_frame(data, 0);
+}
+
+
+void sim_rx_break(void)
+{
+    sim_rx_frame(0x00, SIM_FE);
+}
+
+
+uint16_t sim_rx_skewed(uint8_t data, double skew)
+{
+    /* frame bits as sent: start, data LSB first, stop, then idle line */
+    unsigned frame = 0x200 | ((unsigned)data << 1);
+    unsigned i;
+    unsigned bit;
+    unsigned sampled = 0;
+    uint16_t errors  = 0;
+
+    /* the receiver samples bit i in its middle, (i + 0.5) of its own bit
+       times after the start edge, while the sender's bits last 1 + skew */
+    for ( i = 1; i <= 9; i++ ) {
+        bit = (unsigned)((i + 0.5) / (1.0 + skew));
+        bit = ( bit > 9 ) ? 1 : (frame >> bit) & 1;
+        if ( i <= 8 )
+            sampled |= bit << (i - 1);
+        else if ( !bit )
+            errors = SIM_FE;
+    }
+    return (errors << 8) | sampled;
+}
+
+
+/*
+ *  the character in the shift register is out, the one in UDR follows
+ */
+static void sim_tx_shift(void)
+{
+    sim_tx_commit();
+    if ( sim_tx_level ) {
+        if ( sim_tx_count < SIM_TX_LOG )
+            sim_tx_log[sim_tx_count] = sim_tx_fifo[0];
+        sim_tx_count++;
+        /* as SPI master the receiver shifts in a byte with each one out */
+        if ( SIM_MSPIM && SIM_RXEN )
+            sim_rx_complete(sim_miso ? sim_miso(sim_tx_fifo[0]) : sim_tx_fifo[0], 0);
+        sim_tx_fifo[0] = sim_tx_fifo[1];
+        if ( --sim_tx_level == 0 ) {
+            sim_txc = 1;
+        }else{
+            if ( sim_trace )
+                sim_trace(SIM_TRACE_TXD, sim_tx_done, sim_char_cycles(), sim_tx_fifo[0]);
+            sim_tx_done += sim_char_cycles();
+        }
+    }
+    sim_status();
+}
+
+
+void sim_tx_event(void)
+{
+    sim_tx_shift();
+    sim_pending();
+}
+
+
+void sim_sei(void)
+{
+    sim_sreg |= 1<<SREG_I;
+    sim_pending();
+}
+
+
+unsigned sim_tx_busy(void)
+{
+    sim_tx_commit();
+    return sim_tx_level;
+}
+
+
+/*
+ *  virtual time
+ */
+uint32_t sim_char_cycles(void)
+{
+#ifdef USART_DREIF_bm
+    /* as SPI master 8 bits of two times BAUD/64 clocks */
+    if ( SIM_MSPIM )
+        return 16 * (uint32_t)(sim_usart0.BAUD >> 6);
+    /* BAUD counts 1/64 clocks of the 16 or, with CLK2X, 8 per bit */
+    return ( (sim_usart0.CTRLB & USART_RXMODE_CLK2X_gc) ? 8 : 16 )
+           * (uint32_t)sim_usart0.BAUD * 10 / 64;
+#else
+    uint32_t ubrr = ((sim_ubrr0h & 0x0F) << 8) | sim_ubrr0l;
+
+    /* as SPI master 8 bits of 2 * (UBRR0 + 1) clocks */
+    if ( SIM_MSPIM )
+        return 16 * (ubrr + 1);
+    /* start, 8 data and stop bit of 16 or, with U2X, 8 clocks */
+    return ( (sim_ucsr0a & (1<<U2X0)) ? 8 : 16 ) * (ubrr + 1) * 10;
+#endif
+}
+
+
+void sim_line(uint32_t baudrate)
+{
+    sim_line_char = F_CPU * 10.0 / baudrate;
+}
+
+
+void sim_rx_at(uint64_t time, uint8_t data, uint8_t errors)
+{
+    unsigned next = (sim_rxq_head + 1) % SIM_RX_QUEUE;
+    uint32_t length;
+
+    if ( next == sim_rxq_tail ) {
+        fprintf(stderr, "sim: more than %d characters scheduled\n", SIM_RX_QUEUE - 1);
+        abort();
+    }
+    /* the start bit began a character time of the sender earlier */
+    length = sim_line_char ? (uint32_t)sim_line_char : sim_char_cycles();
+    if ( sim_trace )
+        sim_trace(SIM_TRACE_RXD, time - length, length, (unsigned)(errors & SIM_FE) << 8 | data);
+    sim_rxq[sim_rxq_head].time   = time;
+    sim_rxq[sim_rxq_head].data   = data;
+    sim_rxq[sim_rxq_head].errors = errors;
+    sim_rxq_head = next;
+    if ( time > sim_line_free )
+        sim_line_free = time;
+}
+
+
+uint64_t sim_rx_send(uint8_t data, uint8_t errors)
+{
+    if ( sim_line_free < sim_now )
+        sim_line_free = sim_now;
+    sim_line_free += sim_line_char;
+    sim_rx_at((uint64_t)sim_line_free, data, errors);
+    return (uint64_t)sim_line_free;
+}
+
+
+unsigned sim_rx_queued(void)
+{
+    return (sim_rxq_head - sim_rxq_tail + SIM_RX_QUEUE) % SIM_RX_QUEUE;
+}
+
+
+void sim_run(uint64_t cycles)
+{
+    uint64_t t;
+    int      tx;
+
+    for (;;) {
+        sim_pending();
+        if ( sim_watch )
+            sim_watch();
+
+        /* the next thing to happen on the line, late if an interrupt
+           handler took the time */
+        tx = sim_tx_busy() != 0;
+        t  = tx ? sim_tx_done : UINT64_MAX;
+        if ( sim_rxq_tail != sim_rxq_head && sim_rxq[sim_rxq_tail].time < t ) {
+            t  = sim_rxq[sim_rxq_tail].time;
+            tx = 0;
+        }
+        if ( t == UINT64_MAX || (t > sim_now && t - sim_now > cycles) )
+            break;
+        if ( t > sim_now ) {
+            cycles -= t - sim_now;
+            sim_now = t;
+        }
+
+        if ( tx ) {
+            sim_tx_shift();
+        }else{
+            t = sim_rxq_tail;
+            sim_rxq_tail = (sim_rxq_tail + 1) % SIM_RX_QUEUE;
+            sim_rx_frame(sim_rxq[t].data, sim_rxq[t].errors);
+        }
+    }
+    sim_now += cycles;
+}
+
+
+void sim_trace_udrie(unsigned on)
+{
+    if ( sim_trace )
+        sim_trace(SIM_TRACE_UDRIE, sim_now, 0, on);
+}
@@ -0,0 +1,151 @@
+#ifndef SIM_H
+#define SIM_H
+/************************************************************************
+Title:    Host model of an ATmega328P USART0 for the library tests
+*************************************************************************/
+
+/*
+ *  The model keeps the UCSR0A flags consistent with its state:
+ *  RXC while the two level receive FIFO holds a character, UDRE while the
+ *  transmit buffer has room (the shift register plus UDR hold two
+ *  characters), TXC once both are empty again. Events stand for what
+ *  happens on the line, they run the interrupt handlers like the hardware
+ *  would if the interrupt is enabled in UCSR0B and SREG.
+ *
+ *  The same model runs in virtual time with sim_run(): a clock counts CPU
+ *  cycles, characters scheduled with sim_rx_at() or sim_rx_send() arrive
+ *  when their stop bit completes and each transmitted character takes the
+ *  character time set by UBRR0 and U2X0. Interrupts run at the cycle
+ *  their flag comes up, or as soon as the I flag is set again, and are
+ *  charged sim_isr_cycles each; the cycles given to sim_run() are what the
+ *  main program spends, time spent in interrupts comes on top.
+ *
+ *  FE, UPE and DOR travel with each character through the receive FIFO.
+ *  With both FIFO levels full one more character waits in the shift
+ *  register, the next one to complete overwrites it and is flagged with
+ *  DOR, like the USART does when the receive interrupt is served late.
+ *
+ *  With avr4809/ ahead of this directory in the include path the same
+ *  model is the USART0 of an ATmega4809: the flags are in STATUS, the
+ *  errors of the head character in RXDATAH as FERR, PERR and BUFOVF, the
+ *  interrupt enables in CTRLA and the character time follows BAUD and
+ *  CLK2X.
+ *
+ *  Set to master SPI mode the transmitter clocks 8 bits per byte and the
+ *  receiver, if enabled, completes a byte with each byte sent, without
+ *  start and stop bits and the errors they can have.
+ */
+
+#include <stdint.h>
+
+/** Largest number of transmitted characters recorded */
+#ifndef SIM_TX_LOG
+#define SIM_TX_LOG 4096
+#endif
+
+/** Characters that can be scheduled ahead with sim_rx_at() */
+#ifndef SIM_RX_QUEUE
+#define SIM_RX_QUEUE 65536
+#endif
+
+/*
+ *  receive errors of a character for sim_rx_frame()
+ */
+#define SIM_FE   0x01              /* stop bit was low               */
+#define SIM_PE   0x02              /* parity error                   */
+#define SIM_DOR  0x04              /* characters lost before this one */
+
+/** @brief  Power-on state after UART_Init(), empty FIFOs and logs */
+extern void sim_reset(void);
+
+/** @brief  A character arrives, runs the receive interrupt if enabled */
+extern void sim_rx_event(uint8_t data);
+
+/** @brief  A character arrives with SIM_FE and SIM_PE as given */
+extern void sim_rx_frame(uint8_t data, uint8_t errors);
+
+/** @brief  A break arrives, a frame of zeros whose stop bit is low */
+extern void sim_rx_break(void);
+
+/**
+ *  @brief  What the receiver makes of a character sent with a baud rate
+ *          error, e.g. skew 0.05 for a sender 5 % too slow
+ *  @return received character, SIM_FE in the high byte if the stop bit
+ *          was sampled low
+ */
+extern uint16_t sim_rx_skewed(uint8_t data, double skew);
+
+/** @brief  One character time passes on TXD, runs UDRE/TXC interrupts */
+extern void sim_tx_event(void);
+
+/** @brief  Set the I flag and run the interrupts that became pending */
+extern void sim_sei(void);
+
+/** @brief  Characters sent since sim_reset(), up to SIM_TX_LOG */
+extern uint8_t  sim_tx_log[SIM_TX_LOG];
+extern unsigned sim_tx_count;
+
+/** @brief  Characters still in UDR or the shift register */
+extern unsigned sim_tx_busy(void);
+
+/** @brief  The SPI device's answer to a byte sent in master SPI mode,
+ *          received if the receiver is on; the byte itself if not set */
+extern uint8_t (*sim_miso)(uint8_t mosi);
+
+/** @brief  Called on every UCSR0A access if set, on every USART0 access
+ *          with the newer USART, e.g. to let a character time pass while
+ *          the program polls a flag */
+extern void (*sim_poll)(void);
+
+/** @brief  Virtual time in CPU cycles of F_CPU */
+extern uint64_t sim_now;
+
+/** @brief  Cycles charged for each interrupt, entry and exit included */
+extern unsigned sim_isr_cycles;
+
+/** @brief  Called by sim_run() whenever something may have changed */
+extern void (*sim_watch)(void);
+
+/** @brief  Character time of the USART as the program set it up */
+extern uint32_t sim_char_cycles(void);
+
+/** @brief  Baud rate of the sender at the other end, for sim_rx_send() */
+extern void sim_line(uint32_t baudrate);
+
+/** @brief  Schedule a character to arrive at the given cycle, in order */
+extern void sim_rx_at(uint64_t time, uint8_t data, uint8_t errors);
+
+/**
+ *  @brief  The sender sends a character as soon as its line is free
+ *  @return cycle the character arrives
+ */
+extern uint64_t sim_rx_send(uint8_t data, uint8_t errors);
+
+/** @brief  Characters scheduled that have not arrived yet */
+extern unsigned sim_rx_queued(void);
+
+/** @brief  The main program runs for the given cycles, the line events
+ *          falling into them happen with their interrupts */
+extern void sim_run(uint64_t cycles);
+
+/*
+ *  what sim_trace is told, e.g. to draw waveforms: a character on RXD or
+ *  TXD from the start of its start bit, value data with SIM_FE in the high
+ *  byte; an interrupt handler from its entry, value unused; the UDRE
+ *  interrupt enable as the library changes it, length 0 and value on/off
+ */
+#define SIM_TRACE_RXD    0
+#define SIM_TRACE_TXD    1
+#define SIM_TRACE_RX     2         /* receive complete interrupt     */
+#define SIM_TRACE_UDRE   3         /* data register empty interrupt  */
+#define SIM_TRACE_TXC    4         /* transmit complete interrupt    */
+#define SIM_TRACE_UDRIE  5
+
+/** @brief  Called in virtual time with what happens from time on for length
+ *          cycles, if set */
+extern void (*sim_trace)(unsigned what, uint64_t time, uint32_t length, unsigned value);
+
+/** @brief  UART_TRACE_UDRIE() of the library, see config.h */
+extern void sim_trace_udrie(unsigned on);
+
+#endif
@@ -0,0 +1,222 @@
+/************************************************************************
+Title:    Master SPI transactions on the USART model
+*************************************************************************/
+
+/*
+ *  The library built with UART_MSPIM queues transactions for two devices
+ *  whose chip selects are logged with the bytes out at that moment. In
+ *  virtual time the test checks that each device is selected only around
+ *  its own bytes and deselected once the last one is shifted out, that a
+ *  duplex transaction receives a byte per byte sent and a write only one
+ *  none, that UART_TxAbort() in the middle of a transaction deselects the
+ *  device and leaves the next one to work, and that UART_TxFlushPolled()
+ *  with interrupts disabled runs queued duplex transactions to their end
+ *  without losing a received byte.
+ *
+ *  Built for both USART models, see the Makefile.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "sim.h"
+#include "../uart.h"
+
+#ifndef UART_MSPIM
+#error "spi.c tests the library built with UART_MSPIM"
+#endif
+
+#define SCK_RATE  1000000UL
+#define SELECTS   32
+
+static unsigned failures;
+
+/* chip select changes: device, on/off and bytes out by then */
+static struct {
+    char     device;
+    unsigned on;
+    unsigned sent;
+    unsigned busy;
+} selects[SELECTS];
+static unsigned select_count;
+static char     selected;
+
+
+static void check(int ok, const char *what)
+{
+    if ( !ok ) {
+        failures++;
+        printf("FAIL %s\n", what);
+    }
+}
+
+
+static void cs(char device, unsigned char on)
+{
+    if ( on && selected )
+        check(0, "only one device selected at a time");
+    selected = on ? device : 0;
+    if ( select_count < SELECTS ) {
+        selects[select_count].device = device;
+        selects[select_count].on     = on;
+        selects[select_count].sent   = sim_tx_count;
+        selects[select_count].busy   = sim_tx_busy();
+    }
+    select_count++;
+}
+
+
+static void cs_a(unsigned char on) { cs('a', on); }
+static void cs_b(unsigned char on) { cs('b', on); }
+
+
+/* the device answers the complement of each byte */
+static uint8_t miso(uint8_t mosi)
+{
+    return (uint8_t)~mosi;
+}
+
+
+/*
+ *  a status poll costs the cycles of the loop around it
+ */
+static void poll(void)
+{
+    sim_run(4);
+}
+
+
+static void start(void)
+{
+    UART_Init(UART_SPI_SELECT(SCK_RATE, F_CPU));
+    sim_reset();
+    sim_miso = miso;
+    select_count = 0;
+    selected = 0;
+}
+
+
+static void fill(unsigned char *buf, unsigned len, unsigned char first)
+{
+    while ( len-- )
+        *buf++ = first++;
+}
+
+
+/*
+ *  the next bytes received are the device's answers to buf, without
+ *  errors
+ */
+static int received(const unsigned char *buf, unsigned len)
+{
+    while ( len-- )
+        if ( UART_CharGetNonBlocking() != (unsigned char)~*buf++ )
+            return 0;
+    return 1;
+}
+
+
+/*
+ *  a select, what was out by then and the transmitter idle on deselect
+ */
+static int selected_at(unsigned i, char device, unsigned on, unsigned sent)
+{
+    return i < select_count && selects[i].device == device && selects[i].on == on
+           && selects[i].sent == sent && (on || selects[i].busy == 0);
+}
+
+
+static void test_queue(void)
+{
+    unsigned char a[8], b[5];
+
+    start();
+    fill(a, sizeof(a), 0x10);
+    fill(b, sizeof(b), 0x40);
+    check(UART_SpiTransaction(cs_a, a, sizeof(a), UART_SPI_DUPLEX), "duplex transaction queued");
+    check(UART_SpiTransaction(cs_b, b, sizeof(b), UART_SPI_WRITE), "write transaction queued");
+    sim_run(20 * sim_char_cycles());
+
+    check(sim_tx_count == sizeof(a) + sizeof(b) && memcmp(sim_tx_log, a, sizeof(a)) == 0
+          && memcmp(sim_tx_log + sizeof(a), b, sizeof(b)) == 0,
+          "the bytes of both transactions sent in order");
+    check(select_count == 4, "each device selected and deselected once");
+    check(selected_at(0, 'a', 1, 0) && selected_at(1, 'a', 0, sizeof(a)),
+          "device a selected around its bytes, deselected after the last one");
+    check(selected_at(2, 'b', 1, sizeof(a)) && selected_at(3, 'b', 0, sizeof(a) + sizeof(b)),
+          "device b selected around its bytes, deselected after the last one");
+    check(received(a, sizeof(a)) && UART_CharGetNonBlocking() == UART_NO_DATA,
+          "the duplex transaction received its answers, the write none");
+}
+
+
+static void test_abort(void)
+{
+    unsigned char a[16], b[4];
+    unsigned      sent;
+
+    start();
+    fill(a, sizeof(a), 0x20);
+    fill(b, sizeof(b), 0x60);
+    UART_SpiTransaction(cs_a, a, sizeof(a), UART_SPI_DUPLEX);
+    sim_run(5 * sim_char_cycles() + sim_char_cycles() / 2);
+    sent = sim_tx_count;
+    UART_TxAbort();
+    check(select_count == 2 && selects[1].device == 'a' && !selects[1].on,
+          "UART_TxAbort() deselects the device at once");
+    check(UART_TxPending() == 0, "UART_TxAbort() drops the rest of the transaction");
+    sim_run(4 * sim_char_cycles());
+    check(sim_tx_count <= sent + 2, "no more than the bytes in the USART go out after the abort");
+    check(memcmp(sim_tx_log, a, sim_tx_count) == 0, "the bytes before the abort in order");
+    UART_FlushBuffer();
+
+    sent = sim_tx_count;
+    check(UART_SpiTransaction(cs_b, b, sizeof(b), UART_SPI_DUPLEX), "next transaction queued");
+    sim_run(8 * sim_char_cycles());
+    check(sim_tx_count == sent + sizeof(b) && memcmp(sim_tx_log + sent, b, sizeof(b)) == 0,
+          "the next transaction sent whole");
+    check(selected_at(2, 'b', 1, sent) && selected_at(3, 'b', 0, sent + sizeof(b)),
+          "the next device selected around its bytes");
+    check(received(b, sizeof(b)) && UART_CharGetNonBlocking() == UART_NO_DATA,
+          "the next transaction received its answers");
+}
+
+
+static void test_flush_polled(void)
+{
+    unsigned char a[12], b[12];
+
+    start();
+    fill(a, sizeof(a), 0x80);
+    fill(b, sizeof(b), 0xA0);
+    cli();
+    UART_SpiTransaction(cs_a, a, sizeof(a), UART_SPI_DUPLEX);
+    UART_SpiTransaction(cs_b, b, sizeof(b), UART_SPI_DUPLEX);
+    sim_poll = poll;
+    UART_TxFlushPolled();
+    sim_poll = NULL;
+
+    check(sim_tx_count == sizeof(a) + sizeof(b), "both transactions sent with interrupts off");
+    check(selected_at(1, 'a', 0, sizeof(a)) && selected_at(3, 'b', 0, sizeof(a) + sizeof(b)),
+          "each device deselected after its last byte");
+    /* the last bytes may still be in the receiver */
+    sim_sei();
+    check(received(a, sizeof(a)) && received(b, sizeof(b))
+          && UART_CharGetNonBlocking() == UART_NO_DATA,
+          "every byte of both duplex transactions received, none overrun");
+}
+
+
+int main(void)
+{
+    test_queue();
+    test_abort();
+    test_flush_polled();
+
+#ifdef UART_MODERN_USART
+    printf("spi: newer USART, %u failures\n", failures);
+#else
+    printf("spi: classic USART, %u failures\n", failures);
+#endif
+    return failures != 0;
+}
@@ -0,0 +1,14 @@
+#ifndef SIM_UTIL_CRC16_H
+#define SIM_UTIL_CRC16_H
+/* host version of the avr-libc CRC-16 used by XMODEM */
+#include <stdint.h>
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+    int i;
+
+    crc ^= (uint16_t)data << 8;
+    for ( i = 0; i < 8; i++ )
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    return crc;
+}
+#endif
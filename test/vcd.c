@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "vcd.h"
+
+/* identifier codes are single printable characters */
+#define VCD_SIGNALS  94
+
+static FILE       *vcd_file;
+static const char *vcd_names[VCD_SIGNALS];
+static int         vcd_is_real[VCD_SIGNALS];
+static double      vcd_value[VCD_SIGNALS];
+static int         vcd_known[VCD_SIGNALS];
+static unsigned    vcd_signals;
+static uint64_t    vcd_ps;
+static uint64_t    vcd_time;           /* changes up to here are written */
+static uint64_t    vcd_stamp;          /* time of the last change written */
+static int         vcd_defined;
+static const char *vcd_scope;
+
+/* changes not written yet, a heap ordered by time and then by order given */
+static struct vcd_change {
+    uint64_t time;
+    uint64_t seq;
+    unsigned sig;
+    double   value;
+} *vcd_heap;
+static unsigned vcd_count, vcd_room;
+static uint64_t vcd_seq;
+
+
+static int vcd_before(const struct vcd_change *a, const struct vcd_change *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+
+static void vcd_swap(unsigned a, unsigned b)
+{
+    struct vcd_change t = vcd_heap[a];
+
+    vcd_heap[a] = vcd_heap[b];
+    vcd_heap[b] = t;
+}
+
+
+int vcd_open(const char *name, const char *scope, uint64_t ps_per_tick)
+{
+    vcd_file = fopen(name, "w");
+    if ( !vcd_file )
+        return -1;
+    vcd_scope   = scope;
+    vcd_ps      = ps_per_tick;
+    vcd_signals = 0;
+    vcd_count   = 0;
+    vcd_time    = 0;
+    vcd_stamp   = UINT64_MAX;
+    vcd_defined = 0;
+    return 0;
+}
+
+
+static unsigned vcd_declare(const char *name, int real)
+{
+    if ( vcd_signals == VCD_SIGNALS || vcd_defined ) {
+        fprintf(stderr, "vcd: can't declare %s\n", name);
+        abort();
+    }
+    vcd_names[vcd_signals]   = name;
+    vcd_is_real[vcd_signals] = real;
+    vcd_known[vcd_signals]   = 0;
+    return vcd_signals++;
+}
+
+
+unsigned vcd_wire(const char *name)
+{
+    return vcd_declare(name, 0);
+}
+
+
+unsigned vcd_real(const char *name)
+{
+    return vcd_declare(name, 1);
+}
+
+
+void vcd_set(unsigned sig, uint64_t time, double value)
+{
+    unsigned i;
+
+    if ( !vcd_file )
+        return;
+    if ( vcd_count == vcd_room ) {
+        vcd_room = vcd_room ? 2 * vcd_room : 1024;
+        vcd_heap = realloc(vcd_heap, vcd_room * sizeof(*vcd_heap));
+        if ( !vcd_heap ) {
+            perror("vcd");
+            abort();
+        }
+    }
+    /* too late for the written part, it happens at its end */
+    if ( time < vcd_time )
+        time = vcd_time;
+
+    i = vcd_count++;
+    vcd_heap[i].time  = time;
+    vcd_heap[i].seq   = vcd_seq++;
+    vcd_heap[i].sig   = sig;
+    vcd_heap[i].value = value;
+    while ( i && vcd_before(&vcd_heap[i], &vcd_heap[(i - 1) / 2]) ) {
+        vcd_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+
+void vcd_frame(unsigned sig, uint64_t start, uint32_t length, uint8_t data, int stop)
+{
+    double   bit = length / 10.0;
+    unsigned i;
+
+    vcd_set(sig, start, 0);
+    for ( i = 0; i < 8; i++ )
+        vcd_set(sig, start + (uint64_t)((i + 1) * bit + 0.5), (data >> i) & 1);
+    vcd_set(sig, start + (uint64_t)(9 * bit + 0.5), stop != 0);
+    vcd_set(sig, start + length, 1);
+}
+
+
+static void vcd_header(void)
+{
+    unsigned i;
+
+    fprintf(vcd_file, "$version avruartlib host simulation $end\n"
+                      "$timescale 1ps $end\n"
+                      "$scope module %s $end\n", vcd_scope);
+    for ( i = 0; i < vcd_signals; i++ )
+        fprintf(vcd_file, "$var %s %c %s $end\n", vcd_is_real[i] ? "real 64" : "wire 1",
+                '!' + i, vcd_names[i]);
+    fprintf(vcd_file, "$upscope $end\n$enddefinitions $end\n");
+    vcd_defined = 1;
+}
+
+
+static void vcd_pop(void)
+{
+    unsigned i = 0, c;
+
+    vcd_heap[0] = vcd_heap[--vcd_count];
+    for (;;) {
+        c = 2 * i + 1;
+        if ( c >= vcd_count )
+            break;
+        if ( c + 1 < vcd_count && vcd_before(&vcd_heap[c + 1], &vcd_heap[c]) )
+            c++;
+        if ( !vcd_before(&vcd_heap[c], &vcd_heap[i]) )
+            break;
+        vcd_swap(i, c);
+        i = c;
+    }
+}
+
+
+void vcd_flush(uint64_t time)
+{
+    struct vcd_change ch;
+
+    if ( !vcd_file )
+        return;
+    if ( !vcd_defined )
+        vcd_header();
+    while ( vcd_count && vcd_heap[0].time <= time ) {
+        ch = vcd_heap[0];
+        vcd_pop();
+        if ( vcd_known[ch.sig] && vcd_value[ch.sig] == ch.value )
+            continue;
+        vcd_known[ch.sig] = 1;
+        vcd_value[ch.sig] = ch.value;
+        if ( ch.time != vcd_stamp ) {
+            vcd_stamp = ch.time;
+            fprintf(vcd_file, "#%llu\n", (unsigned long long)(ch.time * vcd_ps));
+        }
+        if ( vcd_is_real[ch.sig] )
+            fprintf(vcd_file, "r%.16g %c\n", ch.value, '!' + ch.sig);
+        else
+            fprintf(vcd_file, "%c%c\n", ch.value != 0 ? '1' : '0', '!' + ch.sig);
+    }
+    if ( time > vcd_time )
+        vcd_time = time;
+}
+
+
+void vcd_close(void)
+{
+    if ( !vcd_file )
+        return;
+    vcd_flush(UINT64_MAX);
+    fclose(vcd_file);
+    vcd_file = NULL;
+}
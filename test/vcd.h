@@ -0,0 +1,41 @@
+#ifndef VCD_H
+#define VCD_H
+/************************************************************************
+Title:    Value Change Dump writer for the host simulations
+*************************************************************************/
+
+/*
+ *  Signals are declared first, then changes are given in any order as
+ *  long as none lies before the time last passed to vcd_flush(): a whole
+ *  character is scheduled at once when its start bit is known. The file
+ *  opens in GTKWave, wires as lines, reals as analog traces with
+ *  "Data Format > Analog".
+ */
+
+#include <stdint.h>
+
+/** @brief  Create the file, time is counted in ticks of ps_per_tick
+ *  @return 0 on success */
+extern int vcd_open(const char *name, const char *scope, uint64_t ps_per_tick);
+
+/** @brief  Declare a one bit signal, before the first change */
+extern unsigned vcd_wire(const char *name);
+
+/** @brief  Declare an analog signal, before the first change */
+extern unsigned vcd_real(const char *name);
+
+/** @brief  The signal takes the value at the given time */
+extern void vcd_set(unsigned sig, uint64_t time, double value);
+
+/** @brief  An 8N1 character on a line signal, low start bit at start,
+ *          data LSB first, the stop bit high unless stop is 0 */
+extern void vcd_frame(unsigned sig, uint64_t start, uint32_t length,
+                      uint8_t data, int stop);
+
+/** @brief  Write the changes up to the given time */
+extern void vcd_flush(uint64_t time);
+
+/** @brief  Write the remaining changes and close the file */
+extern void vcd_close(void);
+
+#endif
@@ -0,0 +1,246 @@
+/************************************************************************
+Title:    Virtual time simulation of main loop, interrupts and the line
+*************************************************************************/
+
+/*
+ *  A sender streams characters at the line rate into the USART model
+ *  while the main loop of an echo application takes them from the
+ *  receive ringbuffer and sends them back. Every pass of the main loop
+ *  costs a fixed number of cycles plus a cost per character, once it
+ *  stalls for a given time with interrupts enabled. The receive interrupt
+ *  keeps filling the ring meanwhile; whether the ring survives depends on
+ *  UART_RX_BUFFER_SIZE, which is set at build time, so "make vtime" runs
+ *  one build per size:
+ *
+ *      vtime-64 -b 115200 -s 5000 -t trace.csv
+ *
+ *  prints the high water mark and the characters lost, exit code 1 if
+ *  any were. The trace has one line per change of the ring levels:
+ *  cycle, time in us, receive level, transmit level. -v writes the run
+ *  as waveforms for GTKWave: RXD and TXD bit by bit, the interrupt
+ *  handlers from entry to exit, UDRIE, the RS-485 driver enable if the
+ *  build has one and the ring levels as analog traces.
+ *
+ *  The library is included rather than linked to see its ring indices.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../uart.c"
+#include "sim.h"
+#include "vcd.h"
+
+#define RX_LEVEL()  ((unsigned char)(UART_RxHead - UART_RxTail) & UART_RX_BUFFER_MASK)
+#define TX_LEVEL()  ((unsigned char)(UART_TxHead - UART_TxTail) & UART_TX_BUFFER_MASK)
+
+/* settings, see usage() */
+static unsigned long baudrate   = 115200;
+static unsigned long stall_us   = 5000;
+static unsigned long stall_at   = 2000;
+static unsigned long length_us  = 20000;
+static unsigned long work       = 400;
+static unsigned long per_char   = 60;
+static unsigned      isr_cost   = 60;
+static const char   *trace_name;
+static const char   *vcd_name;
+
+static FILE    *trace;
+static unsigned rx_high;
+static unsigned last_rx = ~0u, last_tx = ~0u;
+
+/* waveforms */
+static unsigned rxd, txd, de, isr_rx, isr_udre, isr_txc, udrie, rx_level, tx_level;
+
+#define US(c)     ((c) * 1000000.0 / F_CPU)
+#define CYCLES(u) ((uint64_t)(u) * (F_CPU / 1000000UL))
+
+
+/*
+ *  called by the model whenever a level may have changed
+ */
+static void watch(void)
+{
+    unsigned rx = RX_LEVEL();
+    unsigned tx = TX_LEVEL();
+
+    if ( rx > rx_high )
+        rx_high = rx;
+    if ( trace && (rx != last_rx || tx != last_tx) )
+        fprintf(trace, "%llu,%.1f,%u,%u\n", (unsigned long long)sim_now,
+                US(sim_now), rx, tx);
+    last_rx = rx;
+    last_tx = tx;
+
+    if ( vcd_name ) {
+        vcd_set(rx_level, sim_now, rx);
+        vcd_set(tx_level, sim_now, tx);
+#ifdef UART_RS485_DE_PORT
+        vcd_set(de, sim_now, (UART_RS485_DE_PORT >> UART_RS485_DE_BIT) & 1);
+#endif
+        vcd_flush(sim_now);
+    }
+}
+
+
+/*
+ *  called by the model with what happens on the lines and in the CPU
+ */
+static void waveform(unsigned what, uint64_t time, uint32_t length, unsigned value)
+{
+    unsigned isr;
+
+    switch ( what ) {
+    case SIM_TRACE_RXD:
+        vcd_frame(rxd, time, length, (uint8_t)value, !((value >> 8) & SIM_FE));
+        return;
+    case SIM_TRACE_TXD:
+        vcd_frame(txd, time, length, (uint8_t)value, 1);
+        return;
+    case SIM_TRACE_UDRIE:
+        vcd_set(udrie, time, value);
+        return;
+    case SIM_TRACE_RX:
+        isr = isr_rx;
+        break;
+    case SIM_TRACE_UDRE:
+        isr = isr_udre;
+        break;
+    default:
+        isr = isr_txc;
+        break;
+    }
+    vcd_set(isr, time, 1);
+    vcd_set(isr, time + length, 0);
+}
+
+
+static int waveform_open(void)
+{
+    unsigned sig;
+
+    if ( vcd_open(vcd_name, "uart", 1000000000000ULL / F_CPU) )
+        return -1;
+    rxd      = vcd_wire("RXD");
+    txd      = vcd_wire("TXD");
+    de       = vcd_wire("DE");
+    isr_rx   = vcd_wire("RX_ISR");
+    isr_udre = vcd_wire("UDRE_ISR");
+    isr_txc  = vcd_wire("TXC_ISR");
+    udrie    = vcd_wire("UDRIE");
+    rx_level = vcd_real("rx_level");
+    tx_level = vcd_real("tx_level");
+
+    /* idle lines, no interrupt, empty rings */
+    for ( sig = rxd; sig <= tx_level; sig++ )
+        vcd_set(sig, sim_now, sig == rxd || sig == txd);
+    sim_trace = waveform;
+    return 0;
+}
+
+
+/*
+ *  a status poll costs the cycles of the loop around it
+ */
+static void poll(void)
+{
+    sim_run(4);
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-b baud] [-s stall us] [-a stall at us] [-l length us]\n"
+        "          [-w cycles per main loop pass] [-c cycles per character]\n"
+        "          [-i cycles per interrupt] [-t trace.csv] [-v waves.vcd]\n", name);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned char buf[UART_RX_BUFFER_SIZE];
+    unsigned long sent = 0, received = 0, overflows = 0;
+    unsigned int  c;
+    unsigned int  n, i;
+    uint64_t      end, stall;
+    int           opt;
+
+
+    while ( (opt = getopt(argc, argv, "b:s:a:l:w:c:i:t:v:")) != -1 ) {
+        switch ( opt ) {
+        case 'b': baudrate  = strtoul(optarg, NULL, 0); break;
+        case 's': stall_us  = strtoul(optarg, NULL, 0); break;
+        case 'a': stall_at  = strtoul(optarg, NULL, 0); break;
+        case 'l': length_us = strtoul(optarg, NULL, 0); break;
+        case 'w': work      = strtoul(optarg, NULL, 0); break;
+        case 'c': per_char  = strtoul(optarg, NULL, 0); break;
+        case 'i': isr_cost  = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 't': trace_name = optarg; break;
+        case 'v': vcd_name   = optarg; break;
+        default:  usage(argv[0]);
+        }
+    }
+    if ( trace_name ) {
+        trace = fopen(trace_name, "w");
+        if ( !trace ) {
+            perror(trace_name);
+            return 2;
+        }
+        fprintf(trace, "cycle,us,rx,tx\n");
+    }
+
+    /* the closer of the two settings, double speed is closer at 16 MHz */
+    UART_Init(UART_BAUD_SELECT_DOUBLE_SPEED(baudrate, F_CPU));
+    sim_reset();
+    sim_isr_cycles = isr_cost;
+    sim_poll  = poll;
+    sim_watch = watch;
+    sim_line(baudrate);
+    if ( vcd_name && waveform_open() ) {
+        perror(vcd_name);
+        return 2;
+    }
+
+    /* the sender streams back to back for the whole length */
+    end = CYCLES(length_us);
+    while ( sim_rx_send((uint8_t)sent, 0) < end )
+        sent++;
+    sent++;
+
+    stall = CYCLES(stall_at);
+    while ( sim_rx_queued() || RX_LEVEL() ) {
+        if ( stall && sim_now >= stall ) {
+            sim_run(CYCLES(stall_us));
+            stall = 0;
+        }
+        sim_run(work);
+
+        /* echo what came in, as far as the transmit ring takes it */
+        n = UART_CharsAvail();
+        if ( n > UART_TxFree() )
+            n = UART_TxFree();
+        for ( i = 0; i < n; i++ ) {
+            c = UART_CharGetNonBlocking();
+            if ( c & UART_BUFFER_OVERFLOW )
+                overflows++;
+            buf[i] = (unsigned char)c;
+            received++;
+            sim_run(per_char);
+        }
+        UART_BlockPutNonBlocking(buf, n);
+    }
+    while ( TX_LEVEL() || sim_tx_busy() )
+        sim_run(work);
+
+    printf("vtime: RX %3d bytes, %lu bps, %lu us stall: high water %3u, "
+           "%lu of %lu lost%s, %u echoed\n",
+           UART_RX_BUFFER_SIZE, baudrate, stall_us, rx_high, sent - received,
+           sent, overflows ? " (UART_BUFFER_OVERFLOW)" : "", sim_tx_count);
+
+    if ( trace )
+        fclose(trace);
+    vcd_close();
+    return sent != received;
+}
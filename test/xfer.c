@@ -0,0 +1,273 @@
+/************************************************************************
+Title:    XMODEM and YMODEM transfers against a sender model
+*************************************************************************/
+
+/*
+ *  The sender sends a file the way sz does: it waits for 'C', sends the
+ *  YMODEM header block with name and, if asked to, the length, then the
+ *  data blocks padded with SUB, each again after a NAK, EOT until it is
+ *  acknowledged and with YMODEM the empty header that ends the batch. The
+ *  device runs XMODEM_Poll() in a main loop on the USART model in virtual
+ *  time, with a timer tick every millisecond, and keeps the bytes of a
+ *  block once the block callback commits them.
+ *
+ *  Each transfer is checked for XMODEM_DONE, the number of blocks
+ *  committed and the bytes the consumer got: whole blocks with XMODEM and
+ *  an unsized YMODEM file, exactly the file with a sized one, whose
+ *  padding is dropped.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "config.h"
+#include "sim.h"
+#include "../uart.h"
+#include "../xmodem.h"
+
+#define BAUDRATE   115200UL
+#define FILE_MAX   4096
+#define PASS       200                      /* cycles per main loop pass */
+#define TICK       (F_CPU / 1000)           /* timer interrupt period    */
+
+#define SOH  0x01
+#define STX  0x02
+#define EOT  0x04
+#define ACK  0x06
+#define NAK  0x15
+#define CAN  0x18
+#define SUB  0x1A
+
+static unsigned failures;
+
+static unsigned char file[FILE_MAX];
+
+/* the consumer */
+static unsigned char got[FILE_MAX + 1024];
+static unsigned      got_count;             /* bytes committed          */
+static unsigned      block_bytes;           /* bytes of the open block  */
+static unsigned      blocks;                /* blocks committed         */
+
+/* the sender */
+enum { WAIT_C, INFO, INFO_C, DATA, END_EOT, END_C, END_INFO, DONE };
+
+static struct {
+    unsigned      mode;
+    unsigned      length;
+    unsigned      size;     /* bytes per block, 128 or 1024     */
+    int           sized;    /* the length goes into block 0     */
+    unsigned      damage;   /* block to damage on its first try */
+    unsigned      state;
+    unsigned      block;    /* data block being sent, from 1    */
+    unsigned      naks;
+    unsigned      consumed; /* device output read so far        */
+    int           cancelled;
+} tx;
+
+
+static void check(int ok, const char *what)
+{
+    if ( !ok ) {
+        failures++;
+        printf("FAIL %s\n", what);
+    }
+}
+
+
+static void data_cb(unsigned char c)
+{
+    if ( got_count + block_bytes < sizeof(got) )
+        got[got_count + block_bytes] = c;
+    block_bytes++;
+}
+
+
+static void block_cb(unsigned char valid)
+{
+    if ( valid ) {
+        got_count += block_bytes;
+        blocks++;
+    }
+    block_bytes = 0;
+}
+
+
+static void send_block(unsigned seq, const unsigned char *payload, unsigned size, int damage)
+{
+    uint16_t crc = 0;
+    unsigned i;
+
+    sim_rx_send(size == 1024 ? STX : SOH, 0);
+    sim_rx_send((uint8_t)seq, 0);
+    sim_rx_send((uint8_t)~seq, 0);
+    for ( i = 0; i < size; i++ ) {
+        crc = _crc_xmodem_update(crc, payload[i]);
+        /* a bit flipped on the line */
+        sim_rx_send(payload[i] ^ (damage && i == 9 ? 0x04 : 0), 0);
+    }
+    sim_rx_send((uint8_t)(crc >> 8), 0);
+    sim_rx_send((uint8_t)crc, 0);
+}
+
+
+/*
+ *  YMODEM block 0, name and length, or all zeros to end the batch
+ */
+static void send_info(int end)
+{
+    unsigned char info[128];
+
+    memset(info, 0, sizeof(info));
+    if ( !end ) {
+        strcpy((char *)info, "image.bin");
+        if ( tx.sized )
+            sprintf((char *)info + strlen("image.bin") + 1, "%u 0 0", tx.length);
+    }
+    send_block(0, info, sizeof(info), 0);
+}
+
+
+static void send_data(void)
+{
+    unsigned char payload[1024];
+    unsigned      offset = (tx.block - 1) * tx.size;
+    unsigned      n = tx.length - offset;
+
+    if ( n > tx.size )
+        n = tx.size;
+    memcpy(payload, file + offset, n);
+    memset(payload + n, SUB, tx.size - n);
+    send_block(tx.block, payload, tx.size, tx.block == tx.damage);
+    if ( tx.block == tx.damage )
+        tx.damage = 0;
+}
+
+
+/*
+ *  the sender answers what the device sent
+ */
+static void sender(void)
+{
+    unsigned char c;
+
+    while ( tx.consumed < sim_tx_count ) {
+        c = sim_tx_log[tx.consumed++];
+        switch ( c ) {
+        case 'C':
+            if ( tx.state == WAIT_C && tx.mode == XMODEM_MODE_YMODEM ) {
+                send_info(0);
+                tx.state = INFO;
+            }else if ( tx.state == WAIT_C || tx.state == INFO_C ) {
+                tx.block = 1;
+                send_data();
+                tx.state = DATA;
+            }else if ( tx.state == END_C ) {
+                send_info(1);
+                tx.state = END_INFO;
+            }
+            break;
+        case ACK:
+            if ( tx.state == INFO ) {
+                tx.state = INFO_C;
+            }else if ( tx.state == DATA ) {
+                if ( tx.block * tx.size < tx.length ) {
+                    tx.block++;
+                    send_data();
+                }else{
+                    sim_rx_send(EOT, 0);
+                    tx.state = END_EOT;
+                }
+            }else if ( tx.state == END_EOT ) {
+                tx.state = tx.mode == XMODEM_MODE_YMODEM ? END_C : DONE;
+            }else if ( tx.state == END_INFO ) {
+                tx.state = DONE;
+            }
+            break;
+        case NAK:
+            if ( tx.state == DATA ) {
+                tx.naks++;
+                send_data();
+            }else if ( tx.state == END_EOT ) {
+                sim_rx_send(EOT, 0);
+            }
+            break;
+        case CAN:
+            tx.cancelled = 1;
+            break;
+        }
+    }
+}
+
+
+static void run(const char *name, unsigned mode, unsigned size, unsigned length, int sized,
+                unsigned damage)
+{
+    unsigned char status = XMODEM_BUSY;
+    uint64_t      start = sim_now, tick = sim_now + TICK, limit;
+    unsigned      count = (length + size - 1) / size;
+    unsigned      expect, i;
+
+    UART_Init(UART_BAUD_SELECT(BAUDRATE, F_CPU));
+    sim_reset();
+    sim_line(BAUDRATE);
+    XMODEM_Init(mode, data_cb, block_cb);
+    memset(&tx, 0, sizeof(tx));
+    tx.mode   = mode;
+    tx.size   = size;
+    tx.length = length;
+    tx.sized  = sized;
+    tx.damage = damage;
+    got_count = block_bytes = blocks = 0;
+
+    /* every block twice at the line rate and a second to spare */
+    limit = start + 2 * (count + 2) * (size + 5) * (uint64_t)sim_char_cycles() + F_CPU;
+    while ( status == XMODEM_BUSY && sim_now < limit ) {
+        status = XMODEM_Poll();
+        sim_run(PASS);
+        if ( sim_now >= tick ) {
+            tick += TICK;
+            XMODEM_Tick();
+        }
+        sender();
+    }
+    /* the last answer on its way */
+    sim_run(4 * sim_char_cycles());
+    sender();
+
+    expect = ( mode == XMODEM_MODE_YMODEM && sized ) ? length : count * size;
+    check(status == XMODEM_DONE, "the transfer ends with XMODEM_DONE");
+    check(tx.state == DONE && !tx.cancelled, "the sender got to the end");
+    check(blocks == count, "every data block committed once");
+    check(got_count == expect, mode == XMODEM_MODE_YMODEM && sized
+          ? "a sized YMODEM file without the padding" : "every block whole");
+    check(memcmp(got, file, got_count < length ? got_count : length) == 0,
+          "the bytes of the file in order");
+    for ( i = length; i < got_count; i++ )
+        if ( got[i] != SUB )
+            break;
+    check(i >= got_count, "the rest of the last block is padding");
+    check(damage ? tx.naks == 1 : tx.naks == 0, "a NAK for the damaged block only");
+
+    printf("xfer: %-24s %2u blocks, %4u bytes, %u NAKs in %.1f ms\n", name, blocks, got_count,
+           tx.naks, (sim_now - start) * 1000.0 / F_CPU);
+}
+
+
+int main(void)
+{
+    unsigned i;
+
+    for ( i = 0; i < sizeof(file); i++ )
+        file[i] = (unsigned char)(i * 13 + (i >> 7));
+
+    run("XMODEM-CRC", XMODEM_MODE_XMODEM, 128, 1000, 0, 0);
+    run("XMODEM-1K", XMODEM_MODE_XMODEM, 1024, 3000, 0, 0);
+    run("XMODEM-1K damaged", XMODEM_MODE_XMODEM, 1024, 3000, 0, 2);
+    run("YMODEM sized", XMODEM_MODE_YMODEM, 1024, 2500, 1, 0);
+    run("YMODEM sized, 128", XMODEM_MODE_YMODEM, 128, 1000, 1, 0);
+    run("YMODEM sized damaged", XMODEM_MODE_YMODEM, 1024, 2500, 1, 3);
+    run("YMODEM unsized", XMODEM_MODE_YMODEM, 1024, 2500, 0, 0);
+
+    printf("xfer: %u failures\n", failures);
+    return failures != 0;
+}
@@ -1,4 +1,16 @@
+#include <util/delay_basic.h>
 #include "uart.h"
+#ifdef UART_TX_SLEEP
+#include <avr/sleep.h>
+#endif
+
+/*
+ * Everything the interrupt handlers run is forced inline. At -Os gcc would
+ * otherwise keep helpers used from several places out of line, and a call
+ * from an ISR makes it save all call-clobbered registers. This way the
+ * handlers stay leaf functions whose stack use is just their own pushes.
+ */
+#define UART_ISR_INLINE static inline __attribute__((always_inline))
 
 /*
  *  module global variables
@@ -10,15 +22,147 @@ static volatile unsigned char UART_TxTail;
 static volatile unsigned char UART_RxHead;
 static volatile unsigned char UART_RxTail;
 static volatile unsigned char UART_LastRxError;
+static unsigned int  UART_Baudrate;
+static volatile unsigned char UART_TxStarted;   /* data written since TXC */
+#ifdef UART_TXC_CALLBACK
+static void (* volatile UART_TxCompleteFunc)(void);
+#endif
+#ifdef UART_STATS
+static volatile UART_Stats UART_Stat;
+#endif
+#ifdef UART_LATENCY
+static volatile UART_Latency UART_Lat;
+static volatile unsigned int UART_LatNext;    /* expected next arrival */
+static volatile unsigned char UART_LatTicks;  /* ticks since the last one */
+#endif
+#ifdef UART_MSPIM
+static volatile UART_SpiSelectFunc UART_SpiCs[UART_SPI_QUEUE];
+static volatile unsigned char UART_SpiEnd[UART_SPI_QUEUE];  /* last byte in TX ring */
+static volatile unsigned char UART_SpiType[UART_SPI_QUEUE];
+static volatile unsigned char UART_SpiHead;
+static volatile unsigned char UART_SpiTail;     /* last completed transaction */
+static volatile unsigned char UART_SpiBusy;     /* transaction tail+1 running */
+static volatile unsigned char UART_SpiStop;     /* its UART_SpiEnd */
+#endif
+#ifdef UART_CAPTURE
+static volatile UART_Capture UART_CapBuf[UART_CAPTURE_SIZE];
+static volatile unsigned char UART_CapHead;
+static volatile unsigned char UART_CapTail;
+static volatile unsigned char UART_CapLost;
+#endif
+
+
+#ifdef UART_STATS
+/*************************************************************************
+Function: UART_StatsCount()
+Purpose:  count an event or a buffer level sample, saturating at 0xFFFF
+**************************************************************************/
+UART_ISR_INLINE void UART_StatsCount(volatile unsigned int *counter)
+{
+    if ( *counter != 0xFFFF )
+        (*counter)++;
+}
+
+
+/*************************************************************************
+Function: UART_StatsRx()
+Purpose:  account a received character
+**************************************************************************/
+UART_ISR_INLINE void UART_StatsRx(unsigned char lastRxError)
+{
+    unsigned char used = (UART_RxHead - UART_RxTail) & UART_RX_BUFFER_MASK;
+
+    if ( used > UART_Stat.rxHighWater )
+        UART_Stat.rxHighWater = used;
+    UART_StatsCount(&UART_Stat.rxLevels[(used * 8u) / UART_RX_BUFFER_SIZE]);
+    if ( lastRxError & (UART_BUFFER_OVERFLOW >> 8) )
+        UART_StatsCount(&UART_Stat.rxOverflows);
+    if ( lastRxError & (UART_OVERRUN_ERROR >> 8) )
+        UART_StatsCount(&UART_Stat.rxOverruns);
+    if ( lastRxError & ((UART_FRAME_ERROR|UART_PARITY_ERROR) >> 8) )
+        UART_StatsCount(&UART_Stat.rxErrors);
+}
+#endif
+
+
+#ifdef UART_LATENCY
+/*************************************************************************
+Function: UART_LatencyRx()
+Purpose:  measure how late the receive interrupt runs, must be expanded
+          inside the ISR so that the return address is the interrupted code
+**************************************************************************/
+UART_ISR_INLINE void UART_LatencyRx(void)
+{
+    unsigned int  now;
+    unsigned int  late;
+    unsigned char ticks;
+    unsigned char bucket;
+
+    now  = UART_LATENCY_TIME();
+    late = now - UART_LatNext;
+    ticks = UART_LatTicks;
+    UART_LatTicks = 0;
+
+    if ( UART_RX_OVERRUN() ) {
+        /* so late that characters were lost, worse than we can measure */
+        late = 0xFFFF;
+        UART_LatNext = now + UART_LATENCY_CHAR;
+    }else if ( ticks >= 2 || late >= 2 * UART_LATENCY_CHAR ) {
+        /* the line was idle, maybe for a multiple of the timer period, or
+           the character came earlier than expected (late is negative):
+           start over, the first character of a burst can't be judged */
+        UART_LatNext = now + UART_LATENCY_CHAR;
+        return;
+    }else{
+        /* back to back: it arrived one character time after the previous */
+        UART_LatNext += UART_LATENCY_CHAR;
+    }
+
+    /* bucket n holds latencies of n significant bits */
+    for ( bucket = 0; bucket < 16 && (late >> bucket); bucket++ )
+        ;
+    if ( UART_Lat.histogram[bucket] != 0xFFFF )
+        UART_Lat.histogram[bucket]++;
+
+    if ( late >= UART_Lat.worst ) {
+        UART_Lat.worst   = late;
+        UART_Lat.worstPc = (unsigned int)__builtin_return_address(0);
+    }
+}
+#endif
+
+
+#ifdef UART_CAPTURE
+/*************************************************************************
+Function: UART_CaptureRecord()
+Purpose:  append a character to the capture ring, runs with interrupts off
+**************************************************************************/
+UART_ISR_INLINE void UART_CaptureRecord(unsigned char flags, unsigned char data)
+{
+    unsigned char tmphead;
+
+    tmphead = (UART_CapHead + 1) & UART_CAPTURE_MASK;
+    if ( tmphead == UART_CapTail ) {
+        if ( UART_CapLost != 0xFF )
+            UART_CapLost++;
+        return;
+    }
+    UART_CapBuf[tmphead].time  = UART_CAPTURE_TIME();
+    UART_CapBuf[tmphead].flags = flags;
+    UART_CapBuf[tmphead].data  = data;
+    UART_CapHead = tmphead;
+}
+#endif
 
 
 /*
- * 	Module Interrupt Service Routines
+ * 	Receive and transmit handlers, run by the interrupts below or polled
+ *  directly when interrupts can not be used
  */
-ISR(UART_RECEIVE_INTERRUPT)
+UART_ISR_INLINE void UART_RxService(void)
 /*************************************************************************
-Function: UART Receive Complete interrupt
-Purpose:  called when the UART has received a character
+Function: UART_RxService()
+Purpose:  move the received character from the UART into the ringbuffer
 **************************************************************************/
 {
     unsigned char tmphead;
@@ -27,49 +171,257 @@ Purpose:  called when the UART has received a character
     unsigned char lastRxError;
 
     /* read UART status register and UART data register */ 
-    usr  = UART_STATUS;
-    data = UART_DATA;
+    usr  = UART_RX_STATUS;
+    data = UART_RX_DATA;
     
-    /* */
+    /* FE, DOR and PE moved to the bit positions of the error codes */
+    lastRxError = UART_RX_ERRORS(usr);
 
-    lastRxError = (usr & ((1<<FE)|(1<<DOR)));
+    /* a break is a frame of zeros without stop bit */
+    if ( (lastRxError & (UART_FRAME_ERROR >> 8)) && data == 0 )
+        lastRxError |= UART_BREAK >> 8;
 
     /* calculate buffer index */ 
     tmphead = (UART_RxHead + 1) & UART_RX_BUFFER_MASK;
     
     if ( tmphead == UART_RxTail ) {
         /* error: receive buffer overflow */
-        lastRxError = UART_BUFFER_OVERFLOW >> 8;
+        lastRxError |= UART_BUFFER_OVERFLOW >> 8;
     }else{
         /* store new index */
         UART_RxHead = tmphead;
         /* store received data in buffer */
         UART_RxBuf[tmphead] = data;
     }
-    UART_LastRxError = lastRxError;   
+#ifdef UART_STATS
+    UART_StatsRx(lastRxError);
+#endif
+#ifdef UART_CAPTURE
+    UART_CaptureRecord(lastRxError, data);
+#endif
+    /* errors stick until UART_CharGetNonBlocking() reports them,
+       a good character must not hide an earlier loss */
+    UART_LastRxError |= lastRxError;
 }
 
 
-ISR(UART_TRANSMIT_INTERRUPT)
+UART_ISR_INLINE void UART_TxWrite(unsigned char data)
 /*************************************************************************
-Function: UART Data Register Empty interrupt
-Purpose:  called when the UART is ready to transmit the next byte
+Function: UART_TxWrite()
+Purpose:  write a character to the UART and rearm the TXC flag
+**************************************************************************/
+{
+    UART_TX_DATA = data;  /* start transmission */
+    /* UDR is full now, so TXC can only be set again after this character */
+    UART_TXC_CLEAR();
+    UART_TxStarted = 1;
+#ifdef UART_CAPTURE
+    UART_CaptureRecord(UART_CAPTURE_TX >> 8, data);
+#endif
+}
+
+
+/* bytes UART_BlockPutNonBlocking() copies per interrupt disabled run */
+#define UART_TX_RUN   8
+
+/* in MSPIM mode the transmitter stops at the end of each transaction */
+#ifdef UART_MSPIM
+#define UART_TX_LAST  UART_SpiStop
+#else
+#define UART_TX_LAST  UART_TxHead
+#endif
+
+UART_ISR_INLINE void UART_TxService(void)
+/*************************************************************************
+Function: UART_TxService()
+Purpose:  write the next character from the ringbuffer to the UART
 **************************************************************************/
 {
     unsigned char tmptail;
     
-    if ( UART_TxHead != UART_TxTail) {
-        /* calculate and store new buffer index */
-        tmptail = (UART_TxTail + 1) & UART_TX_BUFFER_MASK;
-        UART_TxTail = tmptail;
-        /* get one byte from buffer and write it to UART */
-        UART_DATA = UART_TxBuf[tmptail];  /* start transmission */
+    if ( UART_TX_LAST != UART_TxTail) {
+        /* an idle transmitter takes two bytes, one goes straight on to
+           the shift register, so fill it without a second interrupt */
+        do {
+            /* calculate and store new buffer index */
+            tmptail = (UART_TxTail + 1) & UART_TX_BUFFER_MASK;
+            UART_TxTail = tmptail;
+            /* get one byte from buffer and write it to UART */
+            UART_TxWrite(UART_TxBuf[tmptail]);
+        } while ( UART_TX_LAST != UART_TxTail && (UART_STATUS & (1<<UART_UDRE)) );
     }else{
         /* tx buffer empty, disable UDRE interrupt */
         UART_CONTROL &= ~ (1<<UART_UDRIE);
+        UART_TRACE_UDRIE(0);
     }
 }
 
+
+#ifdef UART_MSPIM
+/*************************************************************************
+Function: UART_SpiStart()
+Purpose:  select the device of the next queued transaction and start it,
+          runs with interrupts off
+**************************************************************************/
+UART_ISR_INLINE void UART_SpiStart(void)
+{
+    unsigned char next = (UART_SpiTail + 1) & UART_SPI_QUEUE_MASK;
+
+    /* the last byte of the previous transaction may still be waiting,
+       switching the receiver off would discard it */
+    while ( UART_STATUS & (1<<UART_RXC) )
+        UART_RxService();
+
+    if ( UART_SpiType[next] == UART_SPI_WRITE )
+        UART_ENABLE &= ~(1<<UART_RXEN);
+    else
+        UART_ENABLE |= (1<<UART_RXEN);
+
+    UART_SpiStop = UART_SpiEnd[next];
+    UART_SpiBusy = 1;
+    UART_SpiCs[next](1);
+
+    UART_CONTROL |= (1<<UART_UDRIE);
+    UART_TRACE_UDRIE(1);
+}
+
+
+/*************************************************************************
+Function: UART_SpiDone()
+Purpose:  deselect the device of the transaction whose last byte is out
+          and start the next one, runs with interrupts off
+**************************************************************************/
+UART_ISR_INLINE void UART_SpiDone(void)
+{
+    UART_SpiTail = (UART_SpiTail + 1) & UART_SPI_QUEUE_MASK;
+    UART_SpiCs[UART_SpiTail](0);
+    UART_SpiBusy = 0;
+    if ( UART_SpiHead != UART_SpiTail )
+        UART_SpiStart();
+}
+#endif
+
+
+/*************************************************************************
+Function: UART_RxPoll()
+Purpose:  fetch received characters when the receive interrupt can't run
+**************************************************************************/
+static inline void UART_RxPoll(void)
+{
+    if ( UART_POLLING() ) {
+        while ( UART_STATUS & (1<<UART_RXC) )
+            UART_RxService();
+    }
+}
+
+
+/*************************************************************************
+Function: UART_TxKick()
+Purpose:  start transmission of data just queued in the ringbuffer
+**************************************************************************/
+static inline void UART_TxKick(void)
+{
+#ifdef UART_STATS
+    unsigned char used;
+#endif
+
+    /* take the bus after queueing, so the TXC interrupt of a previous
+       transmission can't release it under our feet */
+    UART_RS485_TX();
+
+    /* enable UDRE interrupt */
+    UART_CONTROL    |= (1<<UART_UDRIE);
+    UART_TRACE_UDRIE(1);
+
+#ifdef UART_STATS
+    /* the ISR can only lower the level, so this is never too high */
+    used = (UART_TxHead - UART_TxTail) & UART_TX_BUFFER_MASK;
+    if ( used > UART_Stat.txHighWater )
+        UART_Stat.txHighWater = used;
+    UART_StatsCount(&UART_Stat.txLevels[(used * 8u) / UART_TX_BUFFER_SIZE]);
+#endif
+}
+
+
+/*************************************************************************
+Function: UART_TxIdle()
+Purpose:  check that the ringbuffer is empty and the last character is out
+**************************************************************************/
+static inline unsigned char UART_TxIdle(void)
+{
+    return UART_TxHead == UART_TxTail
+           && ( !UART_TxStarted || (UART_STATUS & (1<<UART_TXC)) );
+}
+
+
+#ifndef UART_POLLED
+/*
+ * 	Module Interrupt Service Routines
+ */
+ISR(UART_RECEIVE_INTERRUPT)
+/*************************************************************************
+Function: UART Receive Complete interrupt
+Purpose:  called when the UART has received a character
+**************************************************************************/
+{
+    UART_TRACE_RX_ENTER();
+    /* the receiver buffers two characters, take all that are waiting
+       rather than entering the interrupt again right away */
+    do {
+#ifdef UART_LATENCY
+        /* each character is due one character time after the one
+           before, so the second one waiting is measured on its own */
+        UART_LatencyRx();
+#endif
+        UART_RxService();
+    } while ( UART_STATUS & (1<<UART_RXC) );
+    UART_TRACE_RX_EXIT();
+}
+
+
+ISR(UART_TRANSMIT_INTERRUPT)
+/*************************************************************************
+Function: UART Data Register Empty interrupt
+Purpose:  called when the UART is ready to transmit the next byte
+**************************************************************************/
+{
+    UART_TRACE_TX_ENTER();
+    UART_TxService();
+    UART_TRACE_TX_EXIT();
+}
+
+
+#if defined(UART_TXC_CALLBACK) || defined(UART_RS485_DE_PORT) || defined(UART_MSPIM)
+ISR(UART_TXCOMPLETE_INTERRUPT)
+/*************************************************************************
+Function: UART Transmit Complete interrupt
+Purpose:  called when the last character has left the shift register
+**************************************************************************/
+{
+    /* entering this interrupt cleared TXC, remember that we are done */
+    UART_TxStarted = 0;
+
+    /* release the bus unless new data was queued in the meantime */
+    if ( UART_TxHead == UART_TxTail )
+    {
+        UART_RS485_RX();
+    }
+
+#ifdef UART_MSPIM
+    /* each write rearms TXC, so at the end of the transaction it means
+       that its last byte is out and the device can be deselected */
+    if ( UART_SpiBusy && UART_TxTail == UART_SpiStop )
+        UART_SpiDone();
+#endif
+
+#ifdef UART_TXC_CALLBACK
+    if ( UART_TxCompleteFunc )
+        UART_TxCompleteFunc();
+#endif
+}
+#endif /* UART_TXC_CALLBACK || UART_RS485_DE_PORT || UART_MSPIM */
+#endif /* UART_POLLED */
+
 /*
 ** functions
 */
@@ -82,32 +434,189 @@ Returns:  none
 **************************************************************************/
 void UART_Init(unsigned int baudrate)
 {
+    UART_Baudrate = baudrate;
+    UART_TxStarted = 0;
+
+#ifdef UART_RS485_DE_PORT
+    /* driver enable pin is an output, start in receive direction */
+    UART_RS485_RX();
+    UART_RS485_DE_DDR |= (1<<UART_RS485_DE_BIT);
+#endif
+
     UART_TxHead = 0;
 
     UART_TxTail = 0;
     UART_RxHead = 0;
     UART_RxTail = 0;
+    UART_LastRxError = 0;
+#ifdef UART_MSPIM
+    UART_SpiHead = 0;
+    UART_SpiTail = 0;
+    UART_SpiBusy = 0;
+#endif
+#ifdef UART_LATENCY
+    UART_LatTicks = 2;    /* nothing to measure the first character against */
+#endif
+
+    UART_Start();
+
+}/* UART_init */
 
+
+/*************************************************************************
+Function: UART_Start()
+Purpose:  power up the UART and enable receiver and transmitter
+Input:    none
+Returns:  none
+**************************************************************************/
+void UART_Start(void)
+{
+    unsigned int baudrate = UART_Baudrate;
+#if defined(UART_MODERN_USART) && !defined(UART_MSPIM)
+    unsigned char ctrla = 0;
+    unsigned char ctrlb = USART_RXEN_bm | USART_TXEN_bm;
+#endif
+
+
+#ifdef UART_POWER
+    /* ungate the USART clock, registers must be written again afterwards */
+    UART_POWER &= ~(1<<UART_PRUSART);
+#endif
+
+#if defined(UART_MSPIM) && defined(UART_MODERN_USART)
+    /* master SPI, the receiver is switched per transaction */
+    UART_BAUD    = baudrate;
+    UART_FORMAT  = UART_SPI_FORMAT;
+    UART_ENABLE  = (1<<UART_RXEN)|(1<<UART_TXEN);
+    UART_CONTROL = (1<<UART_RXCIE)|(1<<UART_TXCIE);
+
+#elif defined(UART_MSPIM)
+    /* master SPI, the clock setting has to be zero while the transmitter
+       is enabled for XCK to start right, the receiver is switched per
+       transaction */
+    UART_UBRRH   = 0;
+    UART_UBRRL   = 0;
+    UART_FORMAT  = UART_SPI_FORMAT;
+    UART_CONTROL = (1<<UART_RXCIE)|(1<<UART_TXCIE)|(1<<UART_RXEN)|(1<<UART_TXEN);
+    UART_UBRRH   = (unsigned char)(baudrate>>8);
+    UART_UBRRL   = (unsigned char) baudrate;
+
+#elif defined(UART_MODERN_USART)
+    /* fractional baud rate, bit 15 of the setting selects CLK2X */
+    if ( baudrate & 0x8000 )
+    {
+        ctrlb |= USART_RXMODE_CLK2X_gc;
+        baudrate &= ~0x8000;
+    }
+    UART_BAUD = baudrate;
+
+    /* Set frame format: asynchronous, 8data, no parity, 1stop bit */
+    UART_FORMAT = UART_FORMAT_8N1;
+
+#ifdef UART_RX_WAKEUP
+    /* a start bit wakes the device from standby */
+    ctrlb |= USART_SFDEN_bm;
+#endif
+    UART_ENABLE = ctrlb;
+
+#ifdef UART_RS485_XDIR
+    /* the USART drives XDIR around each transmission */
+    ctrla |= UART_RS485_MODE;
+#endif
+#ifndef UART_POLLED
+    ctrla |= (1<<UART_RXCIE);
+#ifdef UART_RS485_DE_PORT
+    ctrla |= (1<<UART_TXCIE);
+#elif defined(UART_TXC_CALLBACK)
+    if ( UART_TxCompleteFunc )
+        ctrla |= (1<<UART_TXCIE);
+#endif
+#endif
+    UART_CONTROL = ctrla;
+
+#else
     /* Set baud rate */
     if ( baudrate & 0x8000 )
     {
-    	 UART_STATUS = (1<<U2X);  //Enable 2x speed
+    	 UART_STATUS = (1<<UART_U2X);  //Enable 2x speed
     	 baudrate &= ~0x8000;
     }
+    else
+    {
+    	 UART_STATUS = 0;
+    }
 
-    UBRRH = (unsigned char)(baudrate>>8);
-    UBRRL = (unsigned char) baudrate;
+    UART_UBRRH = (unsigned char)(baudrate>>8);
+    UART_UBRRL = (unsigned char) baudrate;
    
+#ifdef UART_POLLED
+    /* Enable USART receiver and transmitter, status flags are polled */
+    UART_CONTROL = (1<<UART_RXEN)|(1<<UART_TXEN);
+#else
     /* Enable USART receiver and transmitter and receive complete interrupt */
-    UART_CONTROL = (1<<RXCIE)|(1<<RXEN)|(1<<TXEN);
+    UART_CONTROL = (1<<UART_RXCIE)|(1<<UART_RXEN)|(1<<UART_TXEN);
+#ifdef UART_RS485_DE_PORT
+    /* the transmit complete interrupt turns the bus around */
+    UART_CONTROL |= (1<<UART_TXCIE);
+#elif defined(UART_TXC_CALLBACK)
+    if ( UART_TxCompleteFunc )
+        UART_CONTROL |= (1<<UART_TXCIE);
+#endif
+#endif
     
     /* Set frame format: asynchronous, 8data, no parity, 1stop bit */
-    UCSRC = (1<<URSEL)|(3<<UCSZ0);
+    UART_FORMAT = UART_FORMAT_8N1;
+#endif /* UART_MSPIM / UART_MODERN_USART */
 
-    /*Enable Global Interrupt*/
-    sei();
-    
-}/* UART_init */
+}/* UART_Start */
+
+
+/*************************************************************************
+Function: UART_Stop()
+Purpose:  finish or abort transmission, disable the UART and gate its clock
+Input:    UART_STOP_DRAIN to send queued data first, UART_STOP_ABORT to
+          discard it
+Returns:  none
+**************************************************************************/
+void UART_Stop(unsigned char mode)
+{
+    if ( mode == UART_STOP_DRAIN ) {
+        UART_TxWait(0);
+    }else{
+        UART_TxAbort();
+    }
+
+    UART_CONTROL = 0;
+#ifdef UART_MODERN_USART
+    UART_ENABLE = 0;
+#endif
+    UART_TxStarted = 0;
+    UART_RS485_RX();
+
+#ifdef UART_POWER
+    UART_POWER |= (1<<UART_PRUSART);
+#endif
+
+}/* UART_Stop */
+
+
+/*************************************************************************
+Function: UART_Deinit()
+Purpose:  shut the UART down and discard buffered data in both directions
+Input:    none
+Returns:  none
+**************************************************************************/
+void UART_Deinit(void)
+{
+    UART_Stop(UART_STOP_ABORT);
+
+    UART_TxHead = 0;
+    UART_TxTail = 0;
+    UART_RxHead = 0;
+    UART_RxTail = 0;
+    UART_LastRxError = 0;
+
+}/* UART_Deinit */
 
 
 /*************************************************************************
@@ -120,20 +629,31 @@ unsigned int UART_CharGetNonBlocking(void)
 {    
     unsigned char tmptail;
     unsigned char data;
+    unsigned char lastRxError;
+    unsigned char sreg;
+
 
+    UART_RxPoll();
 
     if ( UART_RxHead == UART_RxTail ) {
         return UART_NO_DATA;   /* no data available */
     }
 
-    /* calculate /store buffer index */
+    /* calculate buffer index */
     tmptail = (UART_RxTail + 1) & UART_RX_BUFFER_MASK;
-    UART_RxTail = tmptail;
 
-    /* get data from receive buffer */
+    /* get data from receive buffer, then hand the slot back */
     data = UART_RxBuf[tmptail];
+    UART_RxTail = tmptail;
 
-    return (UART_LastRxError << 8) + data;
+    /* fetch and clear the collected errors without losing a new one */
+    sreg = SREG;
+    cli();
+    lastRxError = UART_LastRxError;
+    UART_LastRxError = 0;
+    SREG = sreg;
+
+    return (lastRxError << 8) + data;
 
 }/* UART_getc */
 
@@ -146,22 +666,101 @@ Returns:  none
 **************************************************************************/
 void UART_CharPutNonBlocking(unsigned char data)
 {
+#ifdef UART_POLLED
+    /* nothing empties the ringbuffer, write straight to the UART */
+    while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+        ;/* wait for empty transmit buffer */
+    }
+    UART_RS485_TX();
+    UART_TxWrite(data);
+#else
     unsigned char tmphead;
+    unsigned char sreg;
+#ifdef UART_STATS
+    unsigned char stalled = 0;
+#endif
 
 
-    tmphead  = (UART_TxHead + 1) & UART_TX_BUFFER_MASK;
+    for (;;) {
+        /* other interrupt handlers may put characters too, so take the
+           free slot and publish it in one step */
+        sreg = SREG;
+        cli();
+        tmphead = (UART_TxHead + 1) & UART_TX_BUFFER_MASK;
+        if ( tmphead != UART_TxTail ) {
+            UART_TxBuf[tmphead] = data;
+            UART_TxHead = tmphead;
+            UART_TxKick();
+            SREG = sreg;
+            return;
+        }
+        SREG = sreg;
 
-    while ( tmphead == UART_TxTail ){
-        ;/* wait for free space in buffer */
+#ifdef UART_STATS
+        if ( !stalled ) {
+            stalled = 1;
+            UART_StatsCount(&UART_Stat.txStalls);
+        }
+        if ( UART_Stat.txStallLoops != 0xFFFFFFFFUL )
+            UART_Stat.txStallLoops++;
+#endif
+        if ( UART_POLLING() ) {
+            /* the UDRE interrupt can't run, send just enough to make room */
+            while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+                ;/* wait for empty transmit buffer */
+            }
+            UART_TxService();
+        }
     }
+#endif
 
-    UART_TxBuf[tmphead] = data;
-    UART_TxHead = tmphead;
+}/* uart_putc */
 
-    /* enable UDRE interrupt */
-    UART_CONTROL    |= (1<<UART_UDRIE);
 
-}/* uart_putc */
+/*************************************************************************
+Function: UART_BlockPutNonBlocking()
+Purpose:  copy as many bytes as fit into the transmit ringbuffer
+Input:    data and its length
+Returns:  number of bytes queued
+**************************************************************************/
+unsigned int UART_BlockPutNonBlocking(const unsigned char *buf, unsigned int len)
+{
+    unsigned char tmphead;
+    unsigned char tail;
+    unsigned char sreg;
+    unsigned char run;
+    unsigned int  count = 0;
+
+
+    if ( UART_POLLING() ) {
+        /* make room by polling rather than queue only part of it */
+        while ( count < len )
+            UART_CharPutNonBlocking(buf[count++]);
+        return count;
+    }
+
+    /* other interrupt handlers may put characters too, so copy runs of
+       bytes with interrupts disabled and publish each run to the ISR in
+       one step, short enough not to delay the receive interrupt much */
+    do {
+        sreg = SREG;
+        cli();
+        tmphead = UART_TxHead;
+        tail    = UART_TxTail;
+        for ( run = 0; run < UART_TX_RUN && count < len
+                       && ((tmphead + 1) & UART_TX_BUFFER_MASK) != tail; run++ ) {
+            tmphead = (tmphead + 1) & UART_TX_BUFFER_MASK;
+            UART_TxBuf[tmphead] = buf[count++];
+        }
+        UART_TxHead = tmphead;
+        SREG = sreg;
+    } while ( run == UART_TX_RUN && count < len );
+
+    if ( count )
+        UART_TxKick();
+    return count;
+
+}/* UART_BlockPutNonBlocking */
 
 
 /*************************************************************************
@@ -186,10 +785,23 @@ Returns:  Integer number of bytes in the receive buffer
 **************************************************************************/
 int UART_CharsAvail(void)
 {
-        return (UART_RX_BUFFER_MASK + UART_RxHead - UART_RxTail) % UART_RX_BUFFER_MASK;
+        UART_RxPoll();
+        return (UART_RxHead - UART_RxTail) & UART_RX_BUFFER_MASK;
 }/* uart_available */
 
 
+/*************************************************************************
+Function: UART_RxFree()
+Purpose:  Determine how many more bytes the receive buffer can take
+Input:    None
+Returns:  Integer number of free bytes in the receive buffer
+**************************************************************************/
+int UART_RxFree(void)
+{
+        return UART_RX_BUFFER_MASK - UART_CharsAvail();
+}/* UART_RxFree */
+
+
 /*************************************************************************
 Function: UART_FlushBuffer()
 Purpose:  Flush bytes waiting the receive buffer.  Acutally ignores them.
@@ -198,5 +810,463 @@ Returns:  None
 **************************************************************************/
 void UART_FlushBuffer(void)
 {
-        UART_RxHead = UART_RxTail;
+        /* the tail is ours, the head belongs to the receive interrupt */
+        UART_RxTail = UART_RxHead;
 }/* uart_flush */
+
+
+/*************************************************************************
+Function: UART_BlockGetNonBlocking()
+Purpose:  copy up to len bytes from the receive ringbuffer
+Input:    destination buffer and its size
+Returns:  number of bytes copied
+**************************************************************************/
+unsigned int UART_BlockGetNonBlocking(unsigned char *buf, unsigned int len)
+{
+    unsigned char tmptail;
+    unsigned char head;
+    unsigned int  count = 0;
+
+
+    UART_RxPoll();
+
+    tmptail = UART_RxTail;
+    head    = UART_RxHead;
+
+    while ( count < len && tmptail != head ) {
+        tmptail = (tmptail + 1) & UART_RX_BUFFER_MASK;
+        buf[count++] = UART_RxBuf[tmptail];
+    }
+
+    /* release the copied bytes to the ISR in one step */
+    UART_RxTail = tmptail;
+
+    return count;
+
+}/* UART_BlockGetNonBlocking */
+
+
+/*************************************************************************
+Function: UART_TxFlushPolled()
+Purpose:  transmit everything waiting in the transmit ringbuffer by polling
+          the UART, works with interrupts disabled
+Input:    None
+Returns:  None
+**************************************************************************/
+void UART_TxFlushPolled(void)
+{
+#ifdef UART_MSPIM
+    unsigned char sreg;
+
+
+    /* the TXC interrupt can't end the transactions, end and start them
+       here, each once its last byte has been shifted out */
+    sreg = SREG;
+    cli();
+    while ( UART_SpiBusy ) {
+        /* a duplex transaction receives a byte with each byte sent, the
+           receive interrupt can't fetch them before the receiver overruns;
+           a write only transaction has the receiver off */
+        while ( UART_STATUS & (1<<UART_RXC) )
+            UART_RxService();
+        if ( UART_TxTail == UART_SpiStop ) {
+            while ( !(UART_STATUS & (1<<UART_TXC)) ){
+                ;/* wait for the last byte of the transaction */
+            }
+            UART_SpiDone();
+            continue;
+        }
+        while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+            ;/* wait for empty transmit buffer */
+        }
+        UART_TxService();
+    }
+    SREG = sreg;
+#else
+    while ( UART_TxHead != UART_TxTail ) {
+        while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+            ;/* wait for empty transmit buffer */
+        }
+        UART_TxService();
+    }
+#endif
+
+}/* UART_TxFlushPolled */
+
+
+/*************************************************************************
+Function: UART_TxPending()
+Purpose:  Determine the number of bytes waiting in the transmit buffer
+Input:    None
+Returns:  number of bytes not yet handed to the UART
+**************************************************************************/
+unsigned int UART_TxPending(void)
+{
+    return (UART_TxHead - UART_TxTail) & UART_TX_BUFFER_MASK;
+
+}/* UART_TxPending */
+
+
+/*************************************************************************
+Function: UART_TxFree()
+Purpose:  Determine how many bytes can be queued without blocking
+Input:    None
+Returns:  number of free bytes in the transmit buffer
+**************************************************************************/
+unsigned int UART_TxFree(void)
+{
+    return UART_TX_BUFFER_MASK - UART_TxPending();
+
+}/* UART_TxFree */
+
+
+/*************************************************************************
+Function: UART_CharDelay()
+Purpose:  busy wait for at least one character time at the baudrate given
+          to UART_Init()
+**************************************************************************/
+static void UART_CharDelay(void)
+{
+    unsigned int  setting = UART_Baudrate & ~0x8000;
+    unsigned int  loops;            /* one bit time in 4 cycle loops */
+    unsigned char bits;
+
+
+#if defined(UART_MSPIM) && defined(UART_MODERN_USART)
+    loops = (setting >> 6) / 2 + 1;
+#elif defined(UART_MSPIM)
+    loops = (setting + 1) / 2 + 1;
+#elif defined(UART_MODERN_USART)
+    loops = ( UART_Baudrate & 0x8000 ) ? setting / 32 + 1 : setting / 16 + 1;
+#else
+    loops = ( UART_Baudrate & 0x8000 ) ? 2 * (setting + 1) : 4 * (setting + 1);
+#endif
+    /* start, 8 data and stop bit */
+    for ( bits = 0; bits < 10; bits++ )
+        _delay_loop_2(loops);
+
+}/* UART_CharDelay */
+
+
+/*************************************************************************
+Function: UART_TxWait()
+Purpose:  wait until all queued data has physically been transmitted
+Input:    character times without progress before giving up, 0 = forever
+Returns:  0 when transmission is complete, 1 on timeout
+**************************************************************************/
+unsigned char UART_TxWait(unsigned int timeout)
+{
+    unsigned char tail;
+#ifdef UART_TX_SLEEP
+    unsigned char busy;
+#endif
+    unsigned int  stalled = 0;
+
+
+    while ( !UART_TxIdle() ) {
+        if ( UART_POLLING() ) {
+            UART_TxFlushPolled();
+            continue;
+        }
+        tail = UART_TxTail;
+        if ( timeout ) {
+            /* time can't be counted asleep, check once per character */
+            UART_CharDelay();
+            if ( tail != UART_TxTail )
+                stalled = 0;
+            else if ( ++stalled == timeout )
+                return 1;
+            continue;
+        }
+#ifdef UART_TX_SLEEP
+        /* sleep until the next interrupt, sei() right before sleep_cpu()
+           guarantees that a UDRE or TXC interrupt can't slip in between.
+           Without the TXC interrupt nothing would wake us for the last
+           character, poll its flag then */
+        cli();
+        busy = UART_TxHead != UART_TxTail
+               || ( (UART_CONTROL & (1<<UART_TXCIE)) && !UART_TxIdle() );
+        if ( busy ) {
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+#endif
+    }
+    /* polled transmissions have no TXC interrupt to release the bus */
+    UART_RS485_RX();
+    return 0;
+
+}/* UART_TxWait */
+
+
+/*************************************************************************
+Function: UART_TxAbort()
+Purpose:  discard all data waiting in the transmit buffer
+Input:    None
+Returns:  None
+**************************************************************************/
+void UART_TxAbort(void)
+{
+    unsigned char sreg;
+
+
+    /* no interrupt may see the ringbuffer or the queue half dropped */
+    sreg = SREG;
+    cli();
+    UART_CONTROL &= ~(1<<UART_UDRIE);
+    UART_TRACE_UDRIE(0);
+    UART_TxHead = UART_TxTail;
+
+#ifdef UART_MSPIM
+    /* drop the queue and deselect the device of the running transaction */
+    if ( UART_SpiBusy ) {
+        UART_SpiTail = (UART_SpiTail + 1) & UART_SPI_QUEUE_MASK;
+        UART_SpiCs[UART_SpiTail](0);
+        UART_SpiBusy = 0;
+    }
+    UART_SpiTail = UART_SpiHead;
+#endif
+    SREG = sreg;
+
+}/* UART_TxAbort */
+
+
+#ifdef UART_TXC_CALLBACK
+/*************************************************************************
+Function: UART_TxCompleteCallback()
+Purpose:  set the function called from the transmit complete interrupt
+Input:    callback, NULL disables the interrupt
+Returns:  None
+**************************************************************************/
+void UART_TxCompleteCallback(void (*func)(void))
+{
+    UART_TxCompleteFunc = func;
+    if ( func ) {
+        /* don't report a transmission that ended before we got here */
+        if ( UART_TxHead == UART_TxTail && (UART_STATUS & (1<<UART_TXC)) )
+            UART_TxStarted = 0;
+        UART_TXC_CLEAR();
+        UART_CONTROL |= (1<<UART_TXCIE);
+    }else{
+        /* RS-485 and SPI master mode still need the interrupt */
+#if !defined(UART_RS485_DE_PORT) && !defined(UART_MSPIM)
+        UART_CONTROL &= ~(1<<UART_TXCIE);
+#endif
+    }
+
+}/* UART_TxCompleteCallback */
+#endif
+
+
+#ifdef UART_STATS
+/*************************************************************************
+Function: UART_GetStats()
+Purpose:  take a consistent copy of the statistics
+Input:    destination, reset the statistics afterwards if clear is nonzero
+Returns:  None
+**************************************************************************/
+void UART_GetStats(UART_Stats *stats, unsigned char clear)
+{
+    unsigned char sreg;
+    unsigned char i;
+
+
+    sreg = SREG;
+    cli();
+    *stats = UART_Stat;
+    if ( clear ) {
+        UART_Stat.rxHighWater = 0;
+        UART_Stat.txHighWater = 0;
+        UART_Stat.rxOverflows = 0;
+        UART_Stat.rxOverruns  = 0;
+        UART_Stat.rxErrors    = 0;
+        for ( i = 0; i < UART_STATS_LEVELS; i++ ) {
+            UART_Stat.rxLevels[i] = 0;
+            UART_Stat.txLevels[i] = 0;
+        }
+        UART_Stat.txStalls     = 0;
+        UART_Stat.txStallLoops = 0;
+    }
+    SREG = sreg;
+
+}/* UART_GetStats */
+#endif
+
+
+#ifdef UART_CAPTURE
+/*************************************************************************
+Function: UART_CaptureGet()
+Purpose:  take the oldest record from the capture ring
+Input:    destination record
+Returns:  1 if a record was copied, 0 if the capture ring is empty
+**************************************************************************/
+unsigned char UART_CaptureGet(UART_Capture *rec)
+{
+    unsigned char tmptail;
+
+
+    if ( UART_CapHead == UART_CapTail )
+        return 0;
+
+    tmptail = (UART_CapTail + 1) & UART_CAPTURE_MASK;
+    *rec = UART_CapBuf[tmptail];
+    UART_CapTail = tmptail;
+    return 1;
+
+}/* UART_CaptureGet */
+
+
+/*************************************************************************
+Function: UART_CaptureLost()
+Purpose:  return and reset the number of records dropped on a full ring
+Input:    None
+Returns:  dropped records, saturates at 255
+**************************************************************************/
+unsigned char UART_CaptureLost(void)
+{
+    unsigned char lost;
+    unsigned char sreg;
+
+
+    sreg = SREG;
+    cli();
+    lost = UART_CapLost;
+    UART_CapLost = 0;
+    SREG = sreg;
+    return lost;
+
+}/* UART_CaptureLost */
+#endif
+
+
+#ifdef UART_LATENCY
+/*************************************************************************
+Function: UART_GetLatency()
+Purpose:  take a consistent copy of the receive interrupt latency histogram
+Input:    destination, reset the histogram afterwards if clear is nonzero
+Returns:  None
+**************************************************************************/
+void UART_GetLatency(UART_Latency *lat, unsigned char clear)
+{
+    unsigned char sreg;
+    unsigned char i;
+
+
+    sreg = SREG;
+    cli();
+    *lat = UART_Lat;
+    if ( clear ) {
+        for ( i = 0; i < UART_LATENCY_BUCKETS; i++ )
+            UART_Lat.histogram[i] = 0;
+        UART_Lat.worst   = 0;
+        UART_Lat.worstPc = 0;
+    }
+    SREG = sreg;
+
+}/* UART_GetLatency */
+
+
+/*************************************************************************
+Function: UART_LatencyTick()
+Purpose:  count a timer period, two of them since the last character mean
+          that the line was idle whatever the 16 bit timer difference says
+Input:    None
+Returns:  None
+**************************************************************************/
+void UART_LatencyTick(void)
+{
+    if ( UART_LatTicks < 2 )
+        UART_LatTicks++;
+
+}/* UART_LatencyTick */
+#endif
+
+
+#ifdef UART_MSPIM
+/*************************************************************************
+Function: UART_SpiTransaction()
+Purpose:  queue an SPI transaction, started by the interrupts in turn
+Input:    chip select function, data, its length and the transaction type
+Returns:  1 if queued, 0 if there is no room
+**************************************************************************/
+unsigned char UART_SpiTransaction(UART_SpiSelectFunc select, const unsigned char *buf,
+                                  unsigned char len, unsigned char type)
+{
+    unsigned char tmphead;
+    unsigned char qhead;
+    unsigned char sreg;
+
+
+    qhead = (UART_SpiHead + 1) & UART_SPI_QUEUE_MASK;
+    if ( len == 0 || len > UART_TxFree() || qhead == UART_SpiTail )
+        return 0;
+
+    tmphead = UART_TxHead;
+    while ( len-- ) {
+        tmphead = (tmphead + 1) & UART_TX_BUFFER_MASK;
+        UART_TxBuf[tmphead] = *buf++;
+    }
+    UART_SpiCs[qhead]   = select;
+    UART_SpiEnd[qhead]  = tmphead;
+    UART_SpiType[qhead] = type;
+    UART_TxHead = tmphead;
+
+    /* publish it, and start it unless the TXC interrupt will */
+    sreg = SREG;
+    cli();
+    UART_SpiHead = qhead;
+    if ( !UART_SpiBusy )
+        UART_SpiStart();
+    SREG = sreg;
+    return 1;
+
+}/* UART_SpiTransaction */
+
+
+/*************************************************************************
+Function: UART_SpiBurst()
+Purpose:  write a block to an SPI device by polling the UART
+Input:    chip select function, data and its length
+Returns:  none
+**************************************************************************/
+void UART_SpiBurst(UART_SpiSelectFunc select, const unsigned char *buf, unsigned int len)
+{
+    unsigned char sreg;
+
+
+    if ( len == 0 )
+        return;
+
+    while ( UART_SpiHead != UART_SpiTail ){
+        ;/* wait for the queued transactions */
+    }
+    UART_ENABLE &= ~(1<<UART_RXEN);
+    select(1);
+
+    while ( --len ) {
+        while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+            ;/* wait for empty transmit buffer */
+        }
+        UART_TX_DATA = *buf++;
+    }
+
+    /* the last byte rearms TXC, an interrupt between the write and the
+       rearm could let the previous byte set it */
+    while ( !(UART_STATUS & (1<<UART_UDRE)) ){
+        ;/* wait for empty transmit buffer */
+    }
+    sreg = SREG;
+    cli();
+    UART_TxWrite(*buf);
+    SREG = sreg;
+
+    while ( !UART_TxIdle() ){
+        ;/* wait for the last byte to be shifted out */
+    }
+    select(0);
+
+}/* UART_SpiBurst */
+#endif
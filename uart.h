@@ -35,24 +35,216 @@ Usage:    see Doxygen manual
 ** constants and macros
 */
 
+/*
+ * Device abstraction. The register, bit and vector names of the USART
+ * differ between AVR families, they are mapped to UART_* names here so
+ * that the driver is the same code on all of them:
+ *  - ATmega8/16/32/8535 ...: UCSRA, UDR, USART_RXC_vect, UCSRC shared
+ *    with UBRRH and selected by URSEL
+ *  - ATmega48/88/168/328 ...: UCSR0A, UDR0, USART_RX_vect
+ *  - ATmega164/324/644/1284, ATmega640/1280/2560 ...: UCSR0A, UDR0,
+ *    USART0_RX_vect, more USARTs selected with UART_PORT
+ *  - tinyAVR 0/1/2, ATmega4809 ..., AVR DA/DB/DD: USART0.CTRLA,
+ *    RXDATAL/RXDATAH, TXDATAL, fractional BAUD, USART0_RXC_vect
+ * The bit positions are the same in all classic families and all ports.
+ * The newer USART, UART_MODERN_USART, moves the receive errors to RXDATAH
+ * and splits the control bits over CTRLA and CTRLB, the few places where
+ * that matters are handled by the UART_RX_* and UART_TXC_CLEAR() macros
+ * and in UART_Start()/UART_Stop(). It does not take over the TXD pin,
+ * the application has to make it an output.
+ */
+
+/** USART used on devices with more than one, 0 to 3 */
+#ifndef UART_PORT
+#define UART_PORT 0
+#endif
+
+#define UART_CAT(a,b,c)  a##b##c
+#define UART_XCAT(a,b,c) UART_CAT(a,b,c)
+
+#if defined(URSEL)
 #define UART_RECEIVE_INTERRUPT   	USART_RXC_vect
 #define UART_TRANSMIT_INTERRUPT  	USART_UDRE_vect
+#define UART_TXCOMPLETE_INTERRUPT	USART_TXC_vect
 #define UART_STATUS   				UCSRA
 #define UART_CONTROL  				UCSRB
+#define UART_FORMAT   				UCSRC
 #define UART_DATA    				UDR
+#define UART_UBRRH    				UBRRH
+#define UART_UBRRL    				UBRRL
+#define UART_FORMAT_8N1				((1<<URSEL)|(3<<UCSZ0))
+#define UART_RXC      				RXC
+#define UART_TXC      				TXC
+#define UART_UDRE     				UDRE
+#define UART_FE       				FE
+#define UART_DOR      				DOR
+#define UART_PE       				PE
+#define UART_U2X      				U2X
+#define UART_MPCM     				MPCM
+#define UART_RXCIE    				RXCIE
+#define UART_TXCIE    				TXCIE
 #define UART_UDRIE    				UDRIE
+#define UART_RXEN     				RXEN
+#define UART_TXEN     				TXEN
+
+#elif defined(UDR0)
+#if defined(USART_RX_vect) && UART_PORT == 0
+#define UART_RECEIVE_INTERRUPT   	USART_RX_vect
+#define UART_TRANSMIT_INTERRUPT  	USART_UDRE_vect
+#define UART_TXCOMPLETE_INTERRUPT	USART_TX_vect
+#else
+#define UART_RECEIVE_INTERRUPT   	UART_XCAT(USART, UART_PORT, _RX_vect)
+#define UART_TRANSMIT_INTERRUPT  	UART_XCAT(USART, UART_PORT, _UDRE_vect)
+#define UART_TXCOMPLETE_INTERRUPT	UART_XCAT(USART, UART_PORT, _TX_vect)
+#endif
+#define UART_STATUS   				UART_XCAT(UCSR, UART_PORT, A)
+#define UART_CONTROL  				UART_XCAT(UCSR, UART_PORT, B)
+#define UART_FORMAT   				UART_XCAT(UCSR, UART_PORT, C)
+#define UART_DATA    				UART_XCAT(UDR, UART_PORT, )
+#define UART_UBRRH    				UART_XCAT(UBRR, UART_PORT, H)
+#define UART_UBRRL    				UART_XCAT(UBRR, UART_PORT, L)
+#define UART_FORMAT_8N1				(3<<UCSZ00)
+#define UART_RXC      				RXC0
+#define UART_TXC      				TXC0
+#define UART_UDRE     				UDRE0
+#define UART_FE       				FE0
+#define UART_DOR      				DOR0
+#define UART_PE       				UPE0
+#define UART_U2X      				U2X0
+#define UART_MPCM     				MPCM0
+#define UART_RXCIE    				RXCIE0
+#define UART_TXCIE    				TXCIE0
+#define UART_UDRIE    				UDRIE0
+#define UART_RXEN     				RXEN0
+#define UART_TXEN     				TXEN0
+
+#elif defined(USART0) && defined(USART_DREIF_bm)
+#define UART_MODERN_USART
+#define UART_USARTN   				UART_XCAT(USART, UART_PORT, )
+#define UART_RECEIVE_INTERRUPT   	UART_XCAT(USART, UART_PORT, _RXC_vect)
+#define UART_TRANSMIT_INTERRUPT  	UART_XCAT(USART, UART_PORT, _DRE_vect)
+#define UART_TXCOMPLETE_INTERRUPT	UART_XCAT(USART, UART_PORT, _TXC_vect)
+#define UART_STATUS   				UART_USARTN.STATUS
+#define UART_CONTROL  				UART_USARTN.CTRLA
+#define UART_ENABLE   				UART_USARTN.CTRLB
+#define UART_FORMAT   				UART_USARTN.CTRLC
+#define UART_BAUD     				UART_USARTN.BAUD
+#ifndef UART_RX_DATA
+#define UART_RX_DATA  				UART_USARTN.RXDATAL
+#endif
+#ifndef UART_TX_DATA
+#define UART_TX_DATA  				UART_USARTN.TXDATAL
+#endif
+#define UART_FORMAT_8N1				USART_CHSIZE_8BIT_gc
+#define UART_RXC      				USART_RXCIF_bp
+#define UART_TXC      				USART_TXCIF_bp
+#define UART_UDRE     				USART_DREIF_bp
+#define UART_RXCIE    				USART_RXCIE_bp
+#define UART_TXCIE    				USART_TXCIE_bp
+#define UART_UDRIE    				USART_DREIE_bp
+#define UART_RXEN     				USART_RXEN_bp
+#define UART_TXEN     				USART_TXEN_bp
+/* receive errors are in RXDATAH, read before RXDATAL pops the FIFO;
+   moved to the positions of the error codes */
+#define UART_RX_STATUS				UART_USARTN.RXDATAH
+#define UART_RX_ERRORS(s)			( (((s) & USART_FERR_bm) << 2) \
+									| (((s) & USART_BUFOVF_bm) >> 3) \
+									| (((s) & USART_PERR_bm) << 1) )
+#define UART_RX_OVERRUN()			(UART_RX_STATUS & USART_BUFOVF_bm)
+/* the flags in STATUS are cleared by writing one, writing zero is harmless */
+#ifndef UART_TXC_CLEAR
+#define UART_TXC_CLEAR()			(UART_STATUS = (1<<UART_TXC))
+#endif
+/* hardware RS-485 mode drives the XDIR pin, older headers name it EXT */
+#ifdef USART_RS485_EXT_gc
+#define UART_RS485_MODE				USART_RS485_EXT_gc
+#else
+#define UART_RS485_MODE				USART_RS485_bm
+#endif
+
+#else
+#error "uart.h: USART of this device not supported"
+#endif
+
+/* power reduction register gating the USART clock, if the device has one;
+   only the first USART is handled */
+#if UART_PORT == 0 && defined(PRR) && defined(PRUSART0)
+#define UART_POWER    				PRR
+#define UART_PRUSART  				PRUSART0
+#elif UART_PORT == 0 && defined(PRR0) && defined(PRUSART0)
+#define UART_POWER    				PRR0
+#define UART_PRUSART  				PRUSART0
+#endif
+
+/* the classic USART has one data register and the errors in UCSRA;
+   on either USART config.h may route the data register accesses and
+   the TXC clear to a model of the USART instead, as the host tests in
+   test/ do */
+#ifndef UART_MODERN_USART
+#define UART_ENABLE   				UART_CONTROL
+#ifndef UART_RX_DATA
+#define UART_RX_DATA  				UART_DATA
+#endif
+#ifndef UART_TX_DATA
+#define UART_TX_DATA  				UART_DATA
+#endif
+#define UART_RX_STATUS				UART_STATUS
+#define UART_RX_ERRORS(s)			((s) & ((1<<UART_FE)|(1<<UART_DOR)|(1<<UART_PE)))
+#define UART_RX_OVERRUN()			(UART_STATUS & (1<<UART_DOR))
+/* TXC is cleared by writing one, FE/DOR/PE must be written as zero */
+#ifndef UART_TXC_CLEAR
+#define UART_TXC_CLEAR()			(UART_STATUS = (UART_STATUS & ((1<<UART_U2X)|(1<<UART_MPCM))) | (1<<UART_TXC))
+#endif
+#endif
+
+/*
+ * Trace hooks, empty unless defined in config.h. Pointing them at spare
+ * port pins, e.g. #define UART_TRACE_RX_ENTER() (PORTC |= (1<<PC0)),
+ * shows interrupt activity and the UDRE interrupt enable next to TXD/RXD
+ * on a logic analyzer, which can export the capture as VCD for GTKWave.
+ */
+#ifndef UART_TRACE_RX_ENTER
+#define UART_TRACE_RX_ENTER()
+#endif
+#ifndef UART_TRACE_RX_EXIT
+#define UART_TRACE_RX_EXIT()
+#endif
+#ifndef UART_TRACE_TX_ENTER
+#define UART_TRACE_TX_ENTER()
+#endif
+#ifndef UART_TRACE_TX_EXIT
+#define UART_TRACE_TX_EXIT()
+#endif
+#ifndef UART_TRACE_UDRIE
+#define UART_TRACE_UDRIE(on)
+#endif
+
+/*
+ * The newer USART divides with a fractional baud register,
+ * BAUD = 64 * F_CPU / (16 * baudrate), so the rate is accurate to 1/64 of
+ * a step. Bit 15 flags double speed, so with UART_BAUD_SELECT() the rate
+ * must be at least F_CPU / 8192, e.g. 2442 bps at 20 MHz.
+ */
 
 /** @brief  UART Baudrate Expression
  *  @param  xtalcpu  system clock in Mhz, e.g. 4000000L for 4Mhz
  *  @param  baudrate baudrate in bps, e.g. 1200, 2400, 9600
  */
+#ifdef UART_MODERN_USART
+#define UART_BAUD_SELECT(baudRate,xtalCpu) (((xtalCpu)*4l+(baudRate)/2)/(baudRate))
+#else
 #define UART_BAUD_SELECT(baudRate,xtalCpu) ((xtalCpu)/((baudRate)*16l)-1)
+#endif
 
 /** @brief  UART Baudrate Expression for ATmega double speed mode
  *  @param  xtalcpu  system clock in Mhz, e.g. 4000000L for 4Mhz
  *  @param  baudrate baudrate in bps, e.g. 1200, 2400, 9600
  */
+#ifdef UART_MODERN_USART
+#define UART_BAUD_SELECT_DOUBLE_SPEED(baudRate,xtalCpu) ((((xtalCpu)*8l+(baudRate)/2)/(baudRate))|0x8000)
+#else
 #define UART_BAUD_SELECT_DOUBLE_SPEED(baudRate,xtalCpu) (((xtalCpu)/((baudRate)*8l)-1)|0x8000)
+#endif
 
 /** Size of the circular receive buffer, must be power of 2 */
 #ifndef UART_RX_BUFFER_SIZE
@@ -64,17 +256,228 @@ Usage:    see Doxygen manual
 #define UART_TX_BUFFER_SIZE 32
 #endif
 
+/*
+ * Define UART_POLLED to build the library without interrupt handlers, e.g.
+ * for a bootloader section. The same API is then served by polling the
+ * RXC/UDRE flags and UART_Init() leaves RXCIE and the global interrupt
+ * flag alone. Without it calls made with interrupts disabled, e.g. from
+ * other interrupt handlers, fetch received characters by polling and queue
+ * output as usual, they only poll the transmitter while the transmit
+ * ringbuffer is full. The queued rest goes out once interrupts are enabled
+ * again, or by UART_TxWait() or UART_TxFlushPolled() if they never are.
+ */
+#ifdef UART_POLLED
+#define UART_POLLING()  1
+#else
+#define UART_POLLING()  (!(SREG & (1<<SREG_I)))
+#endif
+
+/* the callback would enable a TXC interrupt that has no handler then */
+#if defined(UART_POLLED) && defined(UART_TXC_CALLBACK)
+#error "UART_TXC_CALLBACK needs the TXC interrupt, which UART_POLLED leaves out"
+#endif
+
 /* size of RX/TX buffers */
 #define UART_RX_BUFFER_MASK ( UART_RX_BUFFER_SIZE - 1)
 #define UART_TX_BUFFER_MASK ( UART_TX_BUFFER_SIZE - 1)
 
+/* buffer indices are unsigned char, masking needs a power of 2 */
+#if UART_RX_BUFFER_SIZE < 2 || UART_RX_BUFFER_SIZE > 256 || (UART_RX_BUFFER_SIZE & UART_RX_BUFFER_MASK)
+#error "UART_RX_BUFFER_SIZE must be a power of 2 from 2 to 256"
+#endif
+#if UART_TX_BUFFER_SIZE < 2 || UART_TX_BUFFER_SIZE > 256 || (UART_TX_BUFFER_SIZE & UART_TX_BUFFER_MASK)
+#error "UART_TX_BUFFER_SIZE must be a power of 2 from 2 to 256"
+#endif
+
+/*
+ * RS-485 half duplex: define UART_RS485_DE_PORT, UART_RS485_DE_DDR and
+ * UART_RS485_DE_BIT for the transceiver's driver enable pin, e.g. PORTD,
+ * DDRD and PD2. The pin goes high before the first character of a
+ * transmission and low from the transmit complete interrupt once the
+ * last stop bit is out, so the bus is released within an interrupt
+ * latency. In polled mode UART_TxWait() releases it.
+ *
+ * The newer USART switches the transceiver itself: define UART_RS485_XDIR
+ * and set its XDIR pin as output, it is then driven from the first start
+ * bit to the end of the last stop bit without any interrupt.
+ */
+
+/*
+ * Define UART_RX_WAKEUP on the newer USART to enable its start-of-frame
+ * detection: a start bit wakes the device from standby sleep and the
+ * character is then received by the normal interrupt.
+ */
+#ifdef UART_RS485_DE_PORT
+#define UART_RS485_TX()  (UART_RS485_DE_PORT |=  (1<<UART_RS485_DE_BIT))
+#define UART_RS485_RX()  (UART_RS485_DE_PORT &= ~(1<<UART_RS485_DE_BIT))
+#else
+#define UART_RS485_TX()
+#define UART_RS485_RX()
+#endif
+
+/*
+ * Define UART_CAPTURE to record every received and transmitted character
+ * with a timestamp, e.g. to replay a customer's traffic later. The time
+ * source UART_CAPTURE_TIME() must be defined too, typically a free running
+ * timer such as TCNT1.
+ */
+#ifdef UART_CAPTURE
+#ifndef UART_CAPTURE_TIME
+#error "UART_CAPTURE needs UART_CAPTURE_TIME() as time stamp source"
+#endif
+/** Number of records in the capture ring, must be power of 2 */
+#ifndef UART_CAPTURE_SIZE
+#define UART_CAPTURE_SIZE 16
+#endif
+#define UART_CAPTURE_MASK ( UART_CAPTURE_SIZE - 1)
+#if UART_CAPTURE_SIZE < 2 || UART_CAPTURE_SIZE > 256 || (UART_CAPTURE_SIZE & UART_CAPTURE_MASK)
+#error "UART_CAPTURE_SIZE must be a power of 2 from 2 to 256"
+#endif
+#endif
+
+/*
+ * Define UART_MSPIM to run the USART as SPI master instead, e.g. to stream
+ * to a display or a DAC. The transmit ringbuffer holds the bytes of the
+ * queued transactions, the received bytes go to the receive ringbuffer as
+ * usual. UART_Init() takes the clock from UART_SPI_SELECT() and
+ * UART_SPI_MODE is the SPI mode 0..3. XCK must be made an output by the
+ * application, on the newer USART clock polarity is set by inverting the
+ * XCK pin (INVEN) instead.
+ */
+#ifdef UART_MSPIM
+#ifdef UART_POLLED
+#error "UART_MSPIM runs its transactions from the interrupts, not with UART_POLLED"
+#endif
+/** SPI mode, clock polarity in bit 1 and phase in bit 0 */
+#ifndef UART_SPI_MODE
+#define UART_SPI_MODE 0
+#endif
+/** Number of transactions that can be queued, must be power of 2 */
+#ifndef UART_SPI_QUEUE
+#define UART_SPI_QUEUE 4
+#endif
+#define UART_SPI_QUEUE_MASK ( UART_SPI_QUEUE - 1)
+#if UART_SPI_QUEUE < 2 || UART_SPI_QUEUE > 256 || (UART_SPI_QUEUE & UART_SPI_QUEUE_MASK)
+#error "UART_SPI_QUEUE must be a power of 2 from 2 to 256"
+#endif
+
+#if defined(UART_MODERN_USART)
+/** @brief  SPI clock setting for UART_Init(), the clock is F_CPU/2 at most */
+#define UART_SPI_SELECT(sckRate,xtalCpu) (((xtalCpu)/((sckRate)*2l))<<6)
+#define UART_SPI_FORMAT				(USART_CMODE_MSPI_gc | ((UART_SPI_MODE & 1) ? USART_UCPHA_bm : 0))
+#elif defined(UMSEL00)
+/** @brief  SPI clock setting for UART_Init(), the clock is F_CPU/2 at most */
+#define UART_SPI_SELECT(sckRate,xtalCpu) ((xtalCpu)/((sckRate)*2l)-1)
+#define UART_SPI_FORMAT				((3<<UMSEL00) | ((UART_SPI_MODE & 1)<<UCPHA0) | ((UART_SPI_MODE >> 1)<<UCPOL0))
+#else
+#error "UART_MSPIM: the USART of this device has no master SPI mode"
+#endif
+
+/*
+** transaction types of UART_SpiTransaction()
+*/
+#define UART_SPI_DUPLEX       0                   /* keep the received bytes     */
+#define UART_SPI_WRITE        1                   /* receiver off, output only   */
+
+/** @brief  Selects (1) or deselects (0) the device of a transaction */
+typedef void (*UART_SpiSelectFunc)(unsigned char select);
+#endif
+
 /*
 ** high byte error return code of uart_getc()
 */
-#define UART_FRAME_ERROR      0x0800              /* Framing Error by UART       */
-#define UART_OVERRUN_ERROR    0x0400              /* Overrun condition by UART   */
+#define UART_BREAK            0x2000              /* Break condition on the line */
+#define UART_FRAME_ERROR      0x1000              /* Framing Error by UART       */
+#define UART_OVERRUN_ERROR    0x0800              /* Overrun condition by UART   */
+#define UART_PARITY_ERROR     0x0400              /* Parity Error by UART        */
 #define UART_BUFFER_OVERFLOW  0x0200              /* receive ringbuffer overflow */
 #define UART_NO_DATA          0x0100              /* no receive data available   */
+#define UART_CAPTURE_TX       0x8000              /* capture: transmitted byte   */
+
+/*
+** modes of UART_Stop()
+*/
+#define UART_STOP_ABORT       0                   /* discard queued output       */
+#define UART_STOP_DRAIN       1                   /* transmit queued output first */
+
+#ifdef UART_STATS
+/*
+ * Statistics collected when the library is built with UART_STATS, used to
+ * size the ringbuffers from what the application really does: if the
+ * high-water mark of a buffer reaches its size-1 it was full at least once.
+ *
+ * The level histograms record how full a buffer was right after each
+ * character was put into it, in eighths of the buffer size: rxLevels[n]
+ * counts received characters that left n/8 to (n+1)/8 of it in use.
+ * txLevels takes one sample per UART_CharPutNonBlocking() call, but only
+ * one per UART_BlockPutNonBlocking() call, after the whole block went in.
+ * All counters stop at their largest value, 0xFFFF and 0xFFFFFFFF for
+ * txStallLoops, rather than wrapping around.
+ */
+#define UART_STATS_LEVELS 8
+
+typedef struct {
+    unsigned char rxHighWater;      /* most bytes ever waiting in RX buffer */
+    unsigned char txHighWater;      /* most bytes ever waiting in TX buffer */
+    unsigned int  rxOverflows;      /* characters dropped, RX buffer full   */
+    unsigned int  rxOverruns;       /* DOR, receive interrupt came too late */
+    unsigned int  rxErrors;         /* frame and parity errors              */
+    unsigned int  rxLevels[UART_STATS_LEVELS];  /* RX level per character  */
+    unsigned int  txLevels[UART_STATS_LEVELS];  /* TX level per character  */
+    unsigned int  txStalls;         /* UART_CharPutNonBlocking() calls that
+                                       had to wait for buffer space         */
+    unsigned long txStallLoops;     /* passes through that wait loop, each
+                                       a few CPU cycles                     */
+} UART_Stats;
+#endif
+
+#ifdef UART_LATENCY
+/*
+ * Receive interrupt latency, collected when the library is built with
+ * UART_LATENCY. UART_LATENCY_TIME() must read a free running 16 bit timer,
+ * e.g. TCNT1, and UART_LATENCY_CHAR is one character time in its ticks,
+ * e.g. (F_CPU / 8 / (115200 / 10)) with a prescaler of 8.
+ *
+ * While characters arrive back to back each one is due a character time
+ * after the previous one, the delay from then to the interrupt is the
+ * latency. The first character after an idle line can't be judged and is
+ * skipped, an overrun counts as 0xFFFF. The 16 bit timer wraps, so the
+ * idle line is told apart by UART_LatencyTick() calls from a periodic
+ * timer interrupt: their period must be at least two character times and
+ * at most 16384 timer ticks, e.g. 1 ms at 115200 bps and TCNT1 at 2 MHz. worstPc is what
+ * __builtin_return_address(0) gives in the interrupt for the worst case,
+ * i.e. the code that was interrupted; avr-gcc returns it as a word address,
+ * so double it for the map file. Usually it lies right behind the code
+ * that kept interrupts disabled for too long.
+ */
+#ifndef UART_LATENCY_TIME
+#error "UART_LATENCY needs UART_LATENCY_TIME() as free running timer"
+#endif
+#ifndef UART_LATENCY_CHAR
+#error "UART_LATENCY needs UART_LATENCY_CHAR, ticks per character"
+#endif
+#define UART_LATENCY_BUCKETS 17
+
+typedef struct {
+    unsigned int  histogram[UART_LATENCY_BUCKETS]; /* [n]: latency has n
+                                        significant bits, i.e. < 2^n ticks  */
+    unsigned int  worst;            /* largest latency in timer ticks       */
+    unsigned int  worstPc;          /* code interrupted in the worst case   */
+} UART_Latency;
+#endif
+
+#ifdef UART_CAPTURE
+/*
+ * One captured character. flags holds UART_CAPTURE_TX>>8 for transmitted
+ * bytes, or the receive error bits (the high byte of
+ * UART_CharGetNonBlocking()) for received ones.
+ */
+typedef struct {
+    unsigned int  time;             /* UART_CAPTURE_TIME() at the ISR       */
+    unsigned char flags;            /* direction and receive errors         */
+    unsigned char data;
+} UART_Capture;
+#endif
 
 /*
 ** function prototypes
@@ -82,17 +485,49 @@ Usage:    see Doxygen manual
 
 /**
    @brief   Initialize UART and set baudrate 
+
+   Clears both ringbuffers and starts the UART. The global interrupt flag
+   is not touched, call sei() once all interrupt handlers are ready.
+
    @param   baudrate Specify baudrate using macro UART_BAUD_SELECT()
    @return  none
 */
 extern void UART_Init(unsigned int baudrate);
 
+/**
+   @brief   Power up the UART and enable receiver and transmitter again
+            after UART_Stop(), using the baudrate given to UART_Init()
+   @param   none
+   @return  none
+*/
+extern void UART_Start(void);
+
+/**
+   @brief   Disable receiver and transmitter and gate the USART clock
+            in the power reduction register, where the device has one
+
+   Received data stays in the ringbuffer. With UART_STOP_DRAIN the call
+   blocks until the transmit ringbuffer and the shift register are empty.
+
+   @param   mode UART_STOP_DRAIN or UART_STOP_ABORT
+   @return  none
+*/
+extern void UART_Stop(unsigned char mode);
+
+/**
+   @brief   Stop the UART and discard all buffered data,
+            UART_Init() must be called before it is used again
+   @param   none
+   @return  none
+*/
+extern void UART_Deinit(void);
+
 
 /**
  *  @brief   Get received byte from ringbuffer
  *
  * Returns in the lower byte the received character and in the 
- * higher byte the last receive error.
+ * higher byte the receive errors that occurred since the previous call.
  * UART_NO_DATA is returned when no data is available.
  *
  *  @param   void
@@ -112,6 +547,11 @@ extern void UART_Init(unsigned int baudrate);
  *             one or more received characters have been dropped.
  *           - \b UART_FRAME_ERROR       
  *             <br>Framing Error by UART
+ *           - \b UART_PARITY_ERROR      
+ *             <br>Parity Error by UART
+ *           - \b UART_BREAK             
+ *             <br>A break (all zero frame) was received,
+ *             always reported together with UART_FRAME_ERROR
  */
 extern unsigned int UART_CharGetNonBlocking(void);
 
@@ -122,6 +562,20 @@ extern unsigned int UART_CharGetNonBlocking(void);
  */
 extern void UART_CharPutNonBlocking(unsigned char data);
 
+/**
+ *  @brief   Put as many bytes as fit into the ringbuffer, without blocking
+ *
+ *  The bytes are made visible to the transmit interrupt in runs of up to
+ *  8, which is cheaper than a UART_CharPutNonBlocking() call per byte when
+ *  sending binary frames. Check UART_TxFree() first to send all or nothing.
+ *  With interrupts disabled it polls the UART to make room for all bytes.
+ *
+ *  @param   buf data to be transmitted
+ *  @param   len number of bytes
+ *  @return  number of bytes queued
+ */
+extern unsigned int UART_BlockPutNonBlocking(const unsigned char *buf, unsigned int len);
+
 /**
  *  @brief   Put string to ringbuffer for transmitting via UART
  *
@@ -134,6 +588,15 @@ extern void UART_CharPutNonBlocking(unsigned char data);
  */
 extern void UART_StringPutNonBlocking(const char *s );
 
+/*
+ * Occupancy of the ringbuffers. One slot of each ringbuffer is kept empty
+ * to tell a full buffer from an empty one, so a buffer holds at most
+ * UART_RX_BUFFER_SIZE-1 / UART_TX_BUFFER_SIZE-1 bytes and used plus free
+ * always adds up to that. Each index is written by one side only, the
+ * interrupt can only make more data (RX) or more space (TX) available
+ * after the call returns, never less.
+ */
+
 /**
  *  @brief   Return number of bytes waiting in the receive buffer
  *  @param   none
@@ -141,13 +604,199 @@ extern void UART_StringPutNonBlocking(const char *s );
  */
 extern int UART_CharsAvail(void);
 
+/**
+ *  @brief   Return number of bytes the receive buffer can still take
+ *  @param   none
+ *  @return  free bytes in the receive buffer
+ */
+extern int UART_RxFree(void);
+
 /**
  *  @brief   Flush bytes waiting in receive buffer
+ *
+ *  Bytes arriving while this runs are either kept or dropped as a whole,
+ *  the receive interrupt is never disturbed.
+ *
  *  @param   none
  *  @return  none
  */
 extern void UART_FlushBuffer(void);
 
+/**
+ *  @brief   Copy up to len received bytes from the ringbuffer
+ *
+ *  Removes as many bytes as are available, but no more than len, and
+ *  returns how many were copied. Used to move whole blocks (e.g. a flash
+ *  page) out of the ringbuffer while the ISR keeps filling it, so that
+ *  the sender can stream ahead instead of waiting on every block.
+ *  Receive errors are not reported, use UART_CharGetNonBlocking() for that.
+ *
+ *  @param   buf destination buffer
+ *  @param   len maximum number of bytes to copy
+ *  @return  number of bytes copied, 0 if no data was available
+ */
+extern unsigned int UART_BlockGetNonBlocking(unsigned char *buf, unsigned int len);
+
+/**
+ *  @brief   Transmit the whole transmit ringbuffer by polling the UART
+ *
+ *  Does not rely on the UDRE interrupt, so it can be used with interrupts
+ *  disabled, e.g. from a fault handler, to get pending output on the wire.
+ *  With UART_MSPIM it also does the work of the TXC interrupt: it runs
+ *  all queued transactions to their end, chip selects included.
+ *
+ *  @param   none
+ *  @return  none
+ */
+extern void UART_TxFlushPolled(void);
+
+/**
+ *  @brief   Return number of bytes waiting in the transmit buffer
+ *  @param   none
+ *  @return  bytes not yet handed to the UART
+ */
+extern unsigned int UART_TxPending(void);
+
+/**
+ *  @brief   Return number of bytes that can be queued without blocking
+ *  @param   none
+ *  @return  free bytes in the transmit buffer
+ */
+extern unsigned int UART_TxFree(void);
+
+/**
+ *  @brief   Wait until all queued data has physically left the UART
+ *
+ *  Returns once the transmit ringbuffer is empty and the last stop bit has
+ *  been shifted out, e.g. before entering a sleep mode or turning an
+ *  RS-485 line around. If the library is built with UART_TX_SLEEP the CPU
+ *  sleeps in the currently selected sleep mode (set_sleep_mode(), usually
+ *  SLEEP_MODE_IDLE) until the next interrupt, rather than spinning.
+ *
+ *  The timeout is counted in character times of the baudrate given to
+ *  UART_Init(), by busy waiting, so the CPU does not sleep when a timeout
+ *  is given. The last byte can take two character times after it left
+ *  the buffer, so a timeout of 3 or more never expires while the UART
+ *  is transmitting normally.
+ *
+ *  @param   timeout character times in which no byte left the buffer
+ *           before giving up, 0 = no limit
+ *  @return  0 when transmission is complete, 1 on timeout
+ */
+extern unsigned char UART_TxWait(unsigned int timeout);
+
+/**
+ *  @brief   Discard all data waiting in the transmit buffer
+ *
+ *  A character already in the UART is still transmitted.
+ *
+ *  @param   none
+ *  @return  none
+ */
+extern void UART_TxAbort(void);
+
+#ifdef UART_TXC_CALLBACK
+/**
+ *  @brief   Set a function called from the transmit complete interrupt
+ *
+ *  Only available if the library is built with UART_TXC_CALLBACK, which
+ *  makes it own the USART TXC vector, and not with UART_POLLED.
+ *  The callback runs in interrupt context, so its stack use adds to that
+ *  of the TXC interrupt, plus the registers saved around an indirect call.
+ *  Apart from it the interrupt handlers only call the chip select
+ *  functions of UART_SpiTransaction() (with UART_MSPIM).
+ *
+ *  @param   func called once all queued data has been sent, NULL disables
+ *  @return  none
+ */
+extern void UART_TxCompleteCallback(void (*func)(void));
+#endif
+
+#ifdef UART_STATS
+/**
+ *  @brief   Copy the statistics collected since the last reset
+ *  @param   stats destination
+ *  @param   clear nonzero to reset the statistics in the same step
+ *  @return  none
+ */
+extern void UART_GetStats(UART_Stats *stats, unsigned char clear);
+#endif
+
+#ifdef UART_LATENCY
+/**
+ *  @brief   Copy the receive interrupt latency histogram
+ *  @param   lat   destination, can be sent to the host as it is
+ *  @param   clear nonzero to reset the histogram in the same step
+ *  @return  none
+ */
+extern void UART_GetLatency(UART_Latency *lat, unsigned char clear);
+
+/**
+ *  @brief   Count time for the latency measurement, call it periodically
+ *           from a timer interrupt as described for UART_LATENCY
+ *  @param   none
+ *  @return  none
+ */
+extern void UART_LatencyTick(void);
+#endif
+
+#ifdef UART_CAPTURE
+/**
+ *  @brief   Take the oldest record from the capture ring
+ *
+ *  Records have to be fetched, e.g. streamed to a host or written to a
+ *  memory card, faster than the traffic fills UART_CAPTURE_SIZE records.
+ *
+ *  @param   rec destination
+ *  @return  1 if a record was copied, 0 if there is none
+ */
+extern unsigned char UART_CaptureGet(UART_Capture *rec);
+
+/**
+ *  @brief   Return and reset the number of records lost on a full capture ring
+ *  @param   none
+ *  @return  lost records, saturating at 255
+ */
+extern unsigned char UART_CaptureLost(void);
+#endif
+
+#ifdef UART_MSPIM
+/**
+ *  @brief   Queue an SPI transaction
+ *
+ *  The bytes are copied to the transmit ringbuffer and clocked out by the
+ *  UDRE interrupt between a select(1) and a select(0) call, made from the
+ *  interrupts once the previous transaction has completed. For
+ *  UART_SPI_DUPLEX transactions every byte clocked out puts one received
+ *  byte into the receive ringbuffer, read it with the usual functions.
+ *  In MSPIM mode all output must go through this function or
+ *  UART_SpiBurst().
+ *
+ *  @param   select chip select of the device, called in interrupt context
+ *  @param   buf    bytes to send
+ *  @param   len    number of bytes, at least 1
+ *  @param   type   UART_SPI_DUPLEX or UART_SPI_WRITE
+ *  @return  1 if queued, 0 if the ringbuffer or the queue has no room
+ */
+extern unsigned char UART_SpiTransaction(UART_SpiSelectFunc select, const unsigned char *buf,
+                                         unsigned char len, unsigned char type);
+
+/**
+ *  @brief   Write a block by polling, at up to the full SPI clock
+ *
+ *  Waits for the transaction queue to empty, so interrupts must be
+ *  enabled if anything is queued. Nothing is received. The interrupt
+ *  driven transactions need two interrupts per byte, this loop keeps the
+ *  transmitter busy even at a clock of F_CPU/2, e.g. for display frames.
+ *
+ *  @param   select chip select of the device
+ *  @param   buf    bytes to send
+ *  @param   len    number of bytes
+ *  @return  none
+ */
+extern void UART_SpiBurst(UART_SpiSelectFunc select, const unsigned char *buf, unsigned int len);
+#endif
+
 /**@}*/
 
 #endif // UART_H
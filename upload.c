@@ -0,0 +1,353 @@
+#include <util/crc16.h>
+#include "uart.h"
+#include "upload.h"
+
+/*
+ *  protocol characters
+ */
+#define UPLOAD_STX  0x02
+#define UPLOAD_EOT  0x04
+#define UPLOAD_ACK  0x06
+#define UPLOAD_NAK  0x15
+#define UPLOAD_CAN  0x18
+
+/*
+ *  receiver states
+ */
+#define UPLOAD_ST_HEADER    0
+#define UPLOAD_ST_SEQ       1
+#define UPLOAD_ST_NSEQ      2
+#define UPLOAD_ST_DATA      3
+#define UPLOAD_ST_CRCH      4
+#define UPLOAD_ST_CRCL      5
+#define UPLOAD_ST_EOT       6
+#define UPLOAD_ST_FINISHED  7
+
+/*
+ *  module global variables
+ */
+static unsigned char     UPLOAD_Buf[2][UPLOAD_PAGE_SIZE];
+static UPLOAD_CommitFunc UPLOAD_Commit;
+static unsigned char     UPLOAD_State;
+static unsigned char     UPLOAD_Status;
+static unsigned char     UPLOAD_Rx;         /* buffer being received        */
+static unsigned char     UPLOAD_Full;       /* it holds a page to commit    */
+static unsigned char     UPLOAD_Seq;        /* next expected page number    */
+static unsigned int      UPLOAD_Page;
+static unsigned char     UPLOAD_RxSeq;
+static unsigned char     UPLOAD_Bad;
+static unsigned char     UPLOAD_Nak;        /* NAK sent, waiting for Seq    */
+static unsigned char     UPLOAD_Eot;
+static unsigned char     UPLOAD_Can;
+static unsigned char     UPLOAD_Retries;
+static unsigned int      UPLOAD_Count;      /* data bytes received          */
+static unsigned int      UPLOAD_Crc;
+static unsigned char     UPLOAD_BusySeq;    /* page being written           */
+static volatile unsigned char UPLOAD_Busy;
+static volatile unsigned char UPLOAD_Acked; /* write done, ACK not sent yet */
+static volatile unsigned char UPLOAD_Timer;
+
+
+/*************************************************************************
+Function: UPLOAD_Answer()
+Purpose:  send a protocol character with a page number
+**************************************************************************/
+static void UPLOAD_Answer(unsigned char c, unsigned char seq)
+{
+    UART_CharPutNonBlocking(c);
+    UART_CharPutNonBlocking(seq);
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Cancel()
+Purpose:  abort the transfer on both sides
+**************************************************************************/
+static void UPLOAD_Cancel(void)
+{
+    UART_CharPutNonBlocking(UPLOAD_CAN);
+    UART_CharPutNonBlocking(UPLOAD_CAN);
+    UPLOAD_State  = UPLOAD_ST_FINISHED;
+    UPLOAD_Status = UPLOAD_ERROR;
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Reject()
+Purpose:  count a failed attempt and ask for the expected page
+**************************************************************************/
+static void UPLOAD_Reject(void)
+{
+    if ( --UPLOAD_Retries == 0 ) {
+        UPLOAD_Cancel();
+    }else{
+        UPLOAD_Nak = 1;
+        UPLOAD_Answer(UPLOAD_NAK, UPLOAD_Seq);
+    }
+    UPLOAD_Timer = UPLOAD_TIMEOUT;
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Start()
+Purpose:  hand the page in the receive buffer to the commit callback and
+          receive into the other buffer
+**************************************************************************/
+static void UPLOAD_Start(unsigned char seq)
+{
+    UPLOAD_BusySeq = seq;
+    UPLOAD_Busy = 1;
+    UPLOAD_Commit(UPLOAD_Page++, UPLOAD_Buf[UPLOAD_Rx]);
+    UPLOAD_Rx ^= 1;
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Trailer()
+Purpose:  verify a completed page and pass it on or reject it
+**************************************************************************/
+static void UPLOAD_Trailer(void)
+{
+    unsigned char behind;
+
+
+    UPLOAD_State = UPLOAD_ST_HEADER;
+
+    /* the CRC run over the data and its own CRC gives zero */
+    if ( UPLOAD_Bad || UPLOAD_Crc != 0 ) {
+        if ( !UPLOAD_Nak || UPLOAD_RxSeq == UPLOAD_Seq )
+            UPLOAD_Reject();
+        return;
+    }
+
+    if ( UPLOAD_RxSeq == UPLOAD_Seq ) {
+        UPLOAD_Seq++;
+        UPLOAD_Nak = 0;
+        UPLOAD_Retries = UPLOAD_RETRIES;
+        if ( UPLOAD_Busy || UPLOAD_Acked )
+            UPLOAD_Full = 1;
+        else
+            UPLOAD_Start(UPLOAD_RxSeq);
+        return;
+    }
+
+    /* a repeat of a page written already: its ACK was lost, unless the
+       page is still waiting for the write and will be acknowledged then */
+    behind = UPLOAD_Seq - UPLOAD_RxSeq;
+    if ( behind <= 8
+         && !(UPLOAD_Full && behind == 1)
+         && !((UPLOAD_Busy || UPLOAD_Acked) && UPLOAD_RxSeq == UPLOAD_BusySeq) )
+        UPLOAD_Answer(UPLOAD_ACK, UPLOAD_RxSeq);
+
+    /* anything else is a page sent ahead of one that was NAKed */
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Data()
+Purpose:  copy the data bytes of the page straight from the ringbuffer
+**************************************************************************/
+static void UPLOAD_Data(void)
+{
+    unsigned char *p = UPLOAD_Buf[UPLOAD_Rx] + UPLOAD_Count;
+    unsigned int   n;
+
+
+    n = UART_BlockGetNonBlocking(p, UPLOAD_PAGE_SIZE - UPLOAD_Count);
+    UPLOAD_Count += n;
+    while ( n-- )
+        UPLOAD_Crc = _crc_xmodem_update(UPLOAD_Crc, *p++);
+
+    if ( UPLOAD_Count == UPLOAD_PAGE_SIZE )
+        UPLOAD_State = UPLOAD_ST_CRCH;
+}
+
+
+/*************************************************************************
+Function: UPLOAD_Input()
+Purpose:  feed one received byte and its UART error flags to the protocol
+          state machine
+**************************************************************************/
+static void UPLOAD_Input(unsigned int c)
+{
+    unsigned char data = (unsigned char)c;
+
+
+    switch ( UPLOAD_State ) {
+    case UPLOAD_ST_HEADER:
+        /* a damaged byte between pages can't be trusted to start one */
+        if ( c & 0xFF00 )
+            break;
+        if ( data != UPLOAD_CAN )
+            UPLOAD_Can = 0;
+        switch ( data ) {
+        case UPLOAD_STX:
+            UPLOAD_State = UPLOAD_ST_SEQ;
+            break;
+        case UPLOAD_EOT:
+            UPLOAD_State = UPLOAD_ST_EOT;
+            break;
+        case UPLOAD_CAN:
+            if ( ++UPLOAD_Can == 2 ) {
+                UPLOAD_State  = UPLOAD_ST_FINISHED;
+                UPLOAD_Status = UPLOAD_ERROR;
+            }
+            break;
+        }
+        break;
+
+    case UPLOAD_ST_SEQ:
+        UPLOAD_RxSeq = data;
+        UPLOAD_State = UPLOAD_ST_NSEQ;
+        break;
+
+    case UPLOAD_ST_NSEQ:
+        UPLOAD_Bad   = (unsigned char)(UPLOAD_RxSeq + data) != 0xFF;
+        UPLOAD_Count = 0;
+        UPLOAD_Crc   = 0;
+        UPLOAD_State = UPLOAD_ST_DATA;
+        break;
+
+    case UPLOAD_ST_CRCH:
+        UPLOAD_Crc = _crc_xmodem_update(UPLOAD_Crc, data);
+        UPLOAD_State = UPLOAD_ST_CRCL;
+        break;
+
+    case UPLOAD_ST_CRCL:
+        UPLOAD_Crc = _crc_xmodem_update(UPLOAD_Crc, data);
+        UPLOAD_Trailer();
+        break;
+
+    case UPLOAD_ST_EOT:
+        /* only a complete, undamaged EOT pair ends the transfer */
+        UPLOAD_State = UPLOAD_ST_HEADER;
+        if ( !(c & 0xFF00) && data == (unsigned char)~UPLOAD_EOT )
+            UPLOAD_Eot = 1;
+        break;
+    }
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: UPLOAD_Init()
+Purpose:  prepare a new transfer
+Input:    page write callback
+Returns:  none
+**************************************************************************/
+void UPLOAD_Init(UPLOAD_CommitFunc commit)
+{
+    UPLOAD_Commit  = commit;
+    UPLOAD_State   = UPLOAD_ST_HEADER;
+    UPLOAD_Status  = UPLOAD_BUSY;
+    UPLOAD_Rx      = 0;
+    UPLOAD_Full    = 0;
+    UPLOAD_Seq     = 0;
+    UPLOAD_Page    = 0;
+    UPLOAD_Eot     = 0;
+    UPLOAD_Can     = 0;
+    UPLOAD_Busy    = 0;
+    UPLOAD_Acked   = 0;
+    UPLOAD_Retries = UPLOAD_RETRIES;
+
+    /* ask for the first page, repeated until it arrives */
+    UPLOAD_Nak   = 1;
+    UPLOAD_Timer = 0;
+
+}/* UPLOAD_Init */
+
+
+/*************************************************************************
+Function: UPLOAD_Committed()
+Purpose:  the page handed to the commit callback has been written
+Input:    none
+Returns:  none
+**************************************************************************/
+void UPLOAD_Committed(void)
+{
+    if ( UPLOAD_Busy ) {
+        UPLOAD_Busy  = 0;
+        UPLOAD_Acked = 1;
+    }
+
+}/* UPLOAD_Committed */
+
+
+/*************************************************************************
+Function: UPLOAD_Tick()
+Purpose:  count down the timeout, called from a periodic timer interrupt
+Input:    none
+Returns:  none
+**************************************************************************/
+void UPLOAD_Tick(void)
+{
+    if ( UPLOAD_Timer )
+        UPLOAD_Timer--;
+
+}/* UPLOAD_Tick */
+
+
+/*************************************************************************
+Function: UPLOAD_Poll()
+Purpose:  receive pages, start page writes and send acknowledges
+Input:    none
+Returns:  UPLOAD_BUSY, UPLOAD_DONE or UPLOAD_ERROR
+**************************************************************************/
+unsigned char UPLOAD_Poll(void)
+{
+    unsigned int c;
+
+
+    if ( UPLOAD_Acked ) {
+        /* the write finished, acknowledge it and start the next one */
+        UPLOAD_Acked = 0;
+        UPLOAD_Answer(UPLOAD_ACK, UPLOAD_BusySeq);
+        if ( UPLOAD_Full ) {
+            UPLOAD_Full = 0;
+            UPLOAD_Start(UPLOAD_Seq - 1);
+        }
+    }
+
+    /* with both buffers taken the next page has to wait in the ringbuffer,
+       the window keeps the host from sending more than fits */
+    while ( UPLOAD_State != UPLOAD_ST_FINISHED && !UPLOAD_Full ) {
+        if ( UPLOAD_State == UPLOAD_ST_DATA ) {
+            if ( !UART_CharsAvail() )
+                break;
+            UPLOAD_Data();
+        }else{
+            c = UART_CharGetNonBlocking();
+            if ( c & UART_NO_DATA )
+                break;
+            UPLOAD_Input(c);
+        }
+        UPLOAD_Timer = UPLOAD_TIMEOUT;
+    }
+
+    if ( UPLOAD_State == UPLOAD_ST_FINISHED )
+        return UPLOAD_Status;
+
+    if ( UPLOAD_Eot && UPLOAD_State == UPLOAD_ST_HEADER
+         && !UPLOAD_Full && !UPLOAD_Busy && !UPLOAD_Acked ) {
+        UART_CharPutNonBlocking(UPLOAD_EOT);
+        UPLOAD_State  = UPLOAD_ST_FINISHED;
+        UPLOAD_Status = UPLOAD_DONE;
+        return UPLOAD_Status;
+    }
+
+    /* waiting for our own flash write is no reason to complain */
+    if ( UPLOAD_Busy || UPLOAD_Full )
+        UPLOAD_Timer = UPLOAD_TIMEOUT;
+
+    if ( UPLOAD_Timer == 0 ) {
+        /* sender stalled, in the middle of a page or before the next */
+        UPLOAD_State = UPLOAD_ST_HEADER;
+        UPLOAD_Reject();
+    }
+
+    return UPLOAD_Status;
+
+}/* UPLOAD_Poll */
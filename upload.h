@@ -0,0 +1,119 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+/************************************************************************
+Title:    Pipelined flash page upload receiver for bootloaders
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup UPLOAD Page upload
+ *  @code #include <upload.h> @endcode
+ *
+ *  @brief Receives a firmware image page by page while the previous page
+ *         is being programmed, so the link does not idle during flash writes.
+ *
+ *  Host to device:
+ *      STX, seq, ~seq, UPLOAD_PAGE_SIZE data bytes, CRC high, CRC low
+ *      EOT, ~EOT once every page has been acknowledged
+ *  Device to host:
+ *      ACK, seq    page seq has been written to flash
+ *      NAK, seq    send again starting with page seq
+ *      EOT         all pages written, transfer complete
+ *      CAN, CAN    transfer aborted
+ *
+ *  seq is the page number modulo 256, starting at 0, the CRC is the
+ *  XMODEM CRC-16 of the data bytes. The device NAKs the page it expects
+ *  until the first one arrives. The host may send up to UPLOAD_WINDOW
+ *  pages ahead of the last ACK: one page is programmed from one buffer
+ *  while the next one streams into the other. After a NAK the host goes
+ *  back to the page named in it, pages that don't follow in sequence are
+ *  dropped until then. A good page that was written already is
+ *  acknowledged again, in case the host missed the ACK.
+ *
+ *  The commit callback is called from UPLOAD_Poll() with a complete page.
+ *  It may write it and call UPLOAD_Committed() before returning, or only
+ *  start the write and call UPLOAD_Committed() later, e.g. once
+ *  boot_spm_busy() is false; the ACK goes out then. Timeouts are counted
+ *  by UPLOAD_Tick() from a periodic timer interrupt, like XMODEM_Tick().
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Bytes per page, the flash page size of the device by default */
+#ifndef UPLOAD_PAGE_SIZE
+#ifdef SPM_PAGESIZE
+#define UPLOAD_PAGE_SIZE SPM_PAGESIZE
+#else
+#define UPLOAD_PAGE_SIZE 128
+#endif
+#endif
+
+/** Pages the host may send beyond the last acknowledged one */
+#define UPLOAD_WINDOW 2
+
+/** Number of UPLOAD_Tick() calls without progress before a timeout */
+#ifndef UPLOAD_TIMEOUT
+#define UPLOAD_TIMEOUT 100
+#endif
+
+/** Number of consecutive timeouts or bad pages before giving up */
+#ifndef UPLOAD_RETRIES
+#define UPLOAD_RETRIES 10
+#endif
+
+/*
+** return codes of UPLOAD_Poll()
+*/
+#define UPLOAD_BUSY           0     /* transfer in progress                */
+#define UPLOAD_DONE           1     /* all pages written                   */
+#define UPLOAD_ERROR          2     /* cancelled or too many retries       */
+
+/** @brief  Writes page number page, data stays valid until UPLOAD_Committed() */
+typedef void (*UPLOAD_CommitFunc)(unsigned int page, const unsigned char *data);
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Prepare a new transfer
+   @param   commit writes a received page to flash
+   @return  none
+*/
+extern void UPLOAD_Init(UPLOAD_CommitFunc commit);
+
+/**
+   @brief   Report that the page handed to the commit callback is written,
+            may be called from the callback itself or from an interrupt
+   @param   none
+   @return  none
+*/
+extern void UPLOAD_Committed(void);
+
+/**
+   @brief   Advance the timeout counter, call from a periodic timer interrupt
+   @param   none
+   @return  none
+*/
+extern void UPLOAD_Tick(void);
+
+/**
+ *  @brief   Receive pages, start page writes and send acknowledges
+ *
+ *  Must be called often enough that the UART receive ringbuffer does not
+ *  overflow while a page is streaming in.
+ *
+ *  @param   none
+ *  @return  UPLOAD_BUSY, UPLOAD_DONE or UPLOAD_ERROR
+ */
+extern unsigned char UPLOAD_Poll(void);
+
+/**@}*/
+
+#endif // UPLOAD_H
@@ -0,0 +1,398 @@
+#include <util/crc16.h>
+#include "uart.h"
+#include "xmodem.h"
+
+/*
+ *  protocol characters
+ */
+#define XMODEM_SOH  0x01
+#define XMODEM_STX  0x02
+#define XMODEM_EOT  0x04
+#define XMODEM_ACK  0x06
+#define XMODEM_NAK  0x15
+#define XMODEM_CAN  0x18
+#define XMODEM_CRC  'C'
+
+/*
+ *  receiver states
+ */
+#define XMODEM_ST_HEADER    0
+#define XMODEM_ST_SEQ       1
+#define XMODEM_ST_NSEQ      2
+#define XMODEM_ST_DATA      3
+#define XMODEM_ST_CRCH      4
+#define XMODEM_ST_CRCL      5
+#define XMODEM_ST_FINISHED  6
+
+/*
+ *  what the current block is used for
+ */
+#define XMODEM_BLK_DATA     0   /* new data block, streamed to the consumer */
+#define XMODEM_BLK_REPEAT   1   /* retransmission of the previous block     */
+#define XMODEM_BLK_FILEINFO 2   /* YMODEM block 0                           */
+
+/*
+ *  module global variables
+ */
+static XMODEM_DataFunc  XMODEM_Data;
+static XMODEM_BlockFunc XMODEM_Block;
+static unsigned char    XMODEM_Mode;
+static unsigned char    XMODEM_State;
+static unsigned char    XMODEM_Status;
+static unsigned char    XMODEM_Seq;         /* next expected block number   */
+static unsigned char    XMODEM_RxSeq;
+static unsigned char    XMODEM_Kind;
+static unsigned char    XMODEM_Bad;
+static unsigned char    XMODEM_Retries;
+static unsigned char    XMODEM_Eot;
+static unsigned char    XMODEM_Can;
+static unsigned char    XMODEM_Poke;        /* char sent on timeout         */
+static unsigned char    XMODEM_Info;        /* YMODEM block 0 parser state  */
+static unsigned char    XMODEM_Null;        /* YMODEM end of batch header   */
+static unsigned char    XMODEM_Sized;       /* YMODEM file length was sent  */
+static unsigned int     XMODEM_Count;       /* payload bytes left in block  */
+static unsigned int     XMODEM_Crc;
+static unsigned long    XMODEM_Length;      /* YMODEM bytes left in file    */
+static unsigned long    XMODEM_BlockLength; /* XMODEM_Length at block start */
+static volatile unsigned char XMODEM_Timer;
+
+
+/*************************************************************************
+Function: XMODEM_Answer()
+Purpose:  send a protocol character and restart the timeout
+**************************************************************************/
+static void XMODEM_Answer(unsigned char c)
+{
+    UART_CharPutNonBlocking(c);
+    XMODEM_Timer = XMODEM_TIMEOUT;
+}
+
+
+/*************************************************************************
+Function: XMODEM_Cancel()
+Purpose:  abort the transfer on both sides
+**************************************************************************/
+static void XMODEM_Cancel(void)
+{
+    UART_CharPutNonBlocking(XMODEM_CAN);
+    UART_CharPutNonBlocking(XMODEM_CAN);
+    XMODEM_State  = XMODEM_ST_FINISHED;
+    XMODEM_Status = XMODEM_ERROR;
+}
+
+
+/*************************************************************************
+Function: XMODEM_Reject()
+Purpose:  count a failed attempt and ask for a retransmission
+**************************************************************************/
+static void XMODEM_Reject(void)
+{
+    if ( --XMODEM_Retries == 0 ) {
+        XMODEM_Cancel();
+    }else{
+        XMODEM_Answer(XMODEM_Poke);
+    }
+}
+
+
+/*************************************************************************
+Function: XMODEM_FileInfo()
+Purpose:  parse YMODEM block 0: "name\0length ..." padded with zeros
+**************************************************************************/
+static void XMODEM_FileInfo(unsigned char data)
+{
+    switch ( XMODEM_Info ) {
+    case 0:     /* first byte of the file name, empty name ends batch */
+        XMODEM_Null = (data == 0);
+        XMODEM_Length = 0;
+        XMODEM_Sized = 0;
+        XMODEM_Info = data ? 1 : 3;
+        break;
+    case 1:     /* rest of the file name */
+        if ( data == 0 )
+            XMODEM_Info = 2;
+        break;
+    case 2:     /* optional decimal file length, ignore digits that would
+                   overflow */
+        if ( data >= '0' && data <= '9' && XMODEM_Length < 0x19999999UL ) {
+            XMODEM_Length = XMODEM_Length * 10 + (data - '0');
+            XMODEM_Sized = 1;
+        }else{
+            XMODEM_Info = 3;
+        }
+        break;
+    }
+}
+
+
+/*************************************************************************
+Function: XMODEM_Header()
+Purpose:  check the block number pair and classify the block
+**************************************************************************/
+static void XMODEM_Header(unsigned char nseq)
+{
+    if ( (unsigned char)(XMODEM_RxSeq + nseq) != 0xFF )
+        XMODEM_Bad = 1;
+    XMODEM_Crc  = 0;
+    XMODEM_Info = 0;
+    XMODEM_BlockLength = XMODEM_Length;
+
+    if ( XMODEM_RxSeq == XMODEM_Seq ) {
+        XMODEM_Kind = ( XMODEM_Mode == XMODEM_MODE_YMODEM && XMODEM_Seq == 0 )
+                      ? XMODEM_BLK_FILEINFO : XMODEM_BLK_DATA;
+    }else if ( XMODEM_RxSeq == (unsigned char)(XMODEM_Seq - 1) || XMODEM_Bad ) {
+        /* already acknowledged, or a damaged header that will be NAKed,
+           noise in the block number must not cancel the transfer */
+        XMODEM_Kind = XMODEM_BLK_REPEAT;
+    }else{
+        /* sender and receiver are out of step, can not recover */
+        XMODEM_Cancel();
+        return;
+    }
+    XMODEM_State = XMODEM_ST_DATA;
+}
+
+
+/*************************************************************************
+Function: XMODEM_Trailer()
+Purpose:  verify the CRC of a completed block and answer the sender
+**************************************************************************/
+static void XMODEM_Trailer(void)
+{
+    unsigned char valid;
+
+
+    /* the CRC run over the payload and its own CRC gives zero */
+    valid = !XMODEM_Bad && XMODEM_Crc == 0;
+    XMODEM_State = XMODEM_ST_HEADER;
+
+    switch ( XMODEM_Kind ) {
+    case XMODEM_BLK_DATA:
+        XMODEM_Block(valid);
+        if ( !valid ) {
+            XMODEM_Length = XMODEM_BlockLength;
+            break;
+        }
+        XMODEM_Seq++;
+        XMODEM_Eot = 0;     /* the NAKed EOT was noise */
+        XMODEM_Retries = XMODEM_RETRIES;
+        XMODEM_Poke = XMODEM_NAK;
+        XMODEM_Answer(XMODEM_ACK);
+        return;
+
+    case XMODEM_BLK_FILEINFO:
+        if ( !valid )
+            break;
+        XMODEM_Answer(XMODEM_ACK);
+        if ( XMODEM_Null ) {
+            XMODEM_State  = XMODEM_ST_FINISHED;
+            XMODEM_Status = XMODEM_DONE;
+        }else if ( XMODEM_Eot ) {
+            /* a second file in the batch is not supported */
+            XMODEM_Cancel();
+        }else{
+            XMODEM_Seq = 1;
+            XMODEM_Retries = XMODEM_RETRIES;
+            XMODEM_Answer(XMODEM_CRC);
+        }
+        return;
+
+    default:
+        if ( !valid )
+            break;
+        XMODEM_Answer(XMODEM_ACK);
+        return;
+    }
+    XMODEM_Reject();
+}
+
+
+/*************************************************************************
+Function: XMODEM_EndOfFile()
+Purpose:  handle EOT, the first one is NAKed and only a repeated EOT ends
+          the file, YMODEM then continues the batch
+**************************************************************************/
+static void XMODEM_EndOfFile(void)
+{
+    if ( !XMODEM_Eot ) {
+        /* a single noise byte must not end the transfer, a sender that
+           means it sends EOT again */
+        XMODEM_Eot = 1;
+        XMODEM_Answer(XMODEM_NAK);
+    }else if ( XMODEM_Mode == XMODEM_MODE_XMODEM ) {
+        XMODEM_Answer(XMODEM_ACK);
+        XMODEM_State  = XMODEM_ST_FINISHED;
+        XMODEM_Status = XMODEM_DONE;
+    }else{
+        XMODEM_Answer(XMODEM_ACK);
+        XMODEM_Seq = 0;
+        XMODEM_Poke = XMODEM_CRC;
+        XMODEM_Retries = XMODEM_RETRIES;
+        XMODEM_Answer(XMODEM_CRC);
+    }
+}
+
+
+/*************************************************************************
+Function: XMODEM_Input()
+Purpose:  feed one received byte and its UART error flags to the protocol
+          state machine
+**************************************************************************/
+static void XMODEM_Input(unsigned int c)
+{
+    unsigned char data = (unsigned char)c;
+
+
+    /* the UART error flags are sticky and arrive with the byte read after
+       the damage, so they can't tell which block it hit; inside a block the
+       CRC decides */
+    switch ( XMODEM_State ) {
+    case XMODEM_ST_HEADER:
+        /* a damaged byte between blocks can't be trusted to start one,
+           to end the transfer or to cancel it */
+        if ( c & 0xFF00 )
+            break;
+        if ( data != XMODEM_CAN )
+            XMODEM_Can = 0;
+        switch ( data ) {
+        case XMODEM_SOH:
+            XMODEM_Count = 128;
+            XMODEM_Bad   = 0;
+            XMODEM_State = XMODEM_ST_SEQ;
+            break;
+        case XMODEM_STX:
+            XMODEM_Count = 1024;
+            XMODEM_Bad   = 0;
+            XMODEM_State = XMODEM_ST_SEQ;
+            break;
+        case XMODEM_EOT:
+            XMODEM_EndOfFile();
+            break;
+        case XMODEM_CAN:
+            if ( ++XMODEM_Can == 2 ) {
+                XMODEM_State  = XMODEM_ST_FINISHED;
+                XMODEM_Status = XMODEM_ERROR;
+            }
+            break;
+        }
+        break;
+
+    case XMODEM_ST_SEQ:
+        XMODEM_RxSeq = data;
+        XMODEM_State = XMODEM_ST_NSEQ;
+        break;
+
+    case XMODEM_ST_NSEQ:
+        XMODEM_Header(data);
+        break;
+
+    case XMODEM_ST_DATA:
+        XMODEM_Crc = _crc_xmodem_update(XMODEM_Crc, data);
+        if ( XMODEM_Kind == XMODEM_BLK_DATA ) {
+            /* YMODEM: drop the padding after the announced file length,
+               without a length everything is data as with XMODEM */
+            if ( XMODEM_Mode == XMODEM_MODE_XMODEM || !XMODEM_Sized ) {
+                XMODEM_Data(data);
+            }else if ( XMODEM_Length ) {
+                XMODEM_Data(data);
+                XMODEM_Length--;
+            }
+        }else if ( XMODEM_Kind == XMODEM_BLK_FILEINFO ) {
+            XMODEM_FileInfo(data);
+        }
+        if ( --XMODEM_Count == 0 )
+            XMODEM_State = XMODEM_ST_CRCH;
+        break;
+
+    case XMODEM_ST_CRCH:
+        XMODEM_Crc = _crc_xmodem_update(XMODEM_Crc, data);
+        XMODEM_State = XMODEM_ST_CRCL;
+        break;
+
+    case XMODEM_ST_CRCL:
+        XMODEM_Crc = _crc_xmodem_update(XMODEM_Crc, data);
+        XMODEM_Trailer();
+        break;
+    }
+}
+
+
+/*
+** functions
+*/
+
+/*************************************************************************
+Function: XMODEM_Init()
+Purpose:  prepare a new transfer
+Input:    protocol, payload and block callbacks
+Returns:  none
+**************************************************************************/
+void XMODEM_Init(unsigned char mode, XMODEM_DataFunc data, XMODEM_BlockFunc block)
+{
+    XMODEM_Mode    = mode;
+    XMODEM_Data    = data;
+    XMODEM_Block   = block;
+    XMODEM_State   = XMODEM_ST_HEADER;
+    XMODEM_Status  = XMODEM_BUSY;
+    XMODEM_Seq     = (mode == XMODEM_MODE_YMODEM) ? 0 : 1;
+    XMODEM_Retries = XMODEM_RETRIES;
+    XMODEM_Eot     = 0;
+    XMODEM_Can     = 0;
+    XMODEM_Length  = 0;
+    XMODEM_Sized   = 0;
+
+    /* ask the sender for CRC mode, repeated until the first block arrives */
+    XMODEM_Poke  = XMODEM_CRC;
+    XMODEM_Timer = 0;
+
+}/* XMODEM_Init */
+
+
+/*************************************************************************
+Function: XMODEM_Tick()
+Purpose:  count down the timeout, called from a periodic timer interrupt
+Input:    none
+Returns:  none
+**************************************************************************/
+void XMODEM_Tick(void)
+{
+    if ( XMODEM_Timer )
+        XMODEM_Timer--;
+
+}/* XMODEM_Tick */
+
+
+/*************************************************************************
+Function: XMODEM_Poll()
+Purpose:  process received bytes and timeouts
+Input:    none
+Returns:  XMODEM_BUSY, XMODEM_DONE or XMODEM_ERROR
+**************************************************************************/
+unsigned char XMODEM_Poll(void)
+{
+    unsigned int c;
+
+
+    while ( XMODEM_State != XMODEM_ST_FINISHED ) {
+        c = UART_CharGetNonBlocking();
+        if ( c & UART_NO_DATA )
+            break;
+        XMODEM_Timer = XMODEM_TIMEOUT;
+        XMODEM_Input(c);
+    }
+
+    if ( XMODEM_State != XMODEM_ST_FINISHED && XMODEM_Timer == 0 ) {
+        if ( XMODEM_State != XMODEM_ST_HEADER ) {
+            /* sender stalled in the middle of a block */
+            if ( XMODEM_State >= XMODEM_ST_DATA && XMODEM_Kind == XMODEM_BLK_DATA ) {
+                XMODEM_Block(0);
+                XMODEM_Length = XMODEM_BlockLength;
+            }
+            XMODEM_State = XMODEM_ST_HEADER;
+        }
+        XMODEM_Reject();
+    }
+
+    return XMODEM_Status;
+
+}/* XMODEM_Poll */
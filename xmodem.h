@@ -0,0 +1,108 @@
+#ifndef XMODEM_H
+#define XMODEM_H
+/************************************************************************
+Title:    XMODEM-1K / YMODEM receiver on top of the interrupt UART library
+Software: avr-gcc (GCC) 4.8.2
+Hardware: any AVR supported by uart.h
+Usage:    see Doxygen manual
+*************************************************************************/
+
+/*
+ *  @defgroup XMODEM Receiver
+ *  @code #include <xmodem.h> @endcode
+ *
+ *  @brief XMODEM-CRC, XMODEM-1K and single file YMODEM receiver.
+ *
+ *  Received data is not buffered: every payload byte is handed to the
+ *  data callback as soon as it has been read from the UART ringbuffer,
+ *  while the CRC-16 is updated on the fly. When the block trailer has been
+ *  checked the block callback tells the consumer whether to commit or
+ *  discard the bytes it got since the last call. A flash writer can
+ *  therefore fill the SPM page buffer directly and only write the page
+ *  when the block is valid.
+ *
+ *  With YMODEM the padding behind the file length announced in block 0 is
+ *  dropped. The length is optional, if block 0 has none every byte of the
+ *  data blocks, padding included, goes to the callback as with XMODEM.
+ *
+ *  The first EOT is NAKed, the transfer or file ends with the EOT the
+ *  sender repeats, so a noise byte between blocks can't end it early.
+ *  Bytes the UART reports with an error are ignored between blocks, inside
+ *  a block the CRC-16 decides whether it is good.
+ *
+ *  Timeouts are counted by XMODEM_Tick(), which is meant to be called from
+ *  a periodic timer interrupt, XMODEM_Poll() does the actual work from the
+ *  main loop.
+ */
+
+/**@{*/
+
+/*
+** constants and macros
+*/
+
+/** Number of XMODEM_Tick() calls without receive data before a timeout */
+#ifndef XMODEM_TIMEOUT
+#define XMODEM_TIMEOUT 100
+#endif
+
+/** Number of consecutive timeouts or bad blocks before giving up */
+#ifndef XMODEM_RETRIES
+#define XMODEM_RETRIES 10
+#endif
+
+/*
+** protocol selection for XMODEM_Init()
+*/
+#define XMODEM_MODE_XMODEM    0     /* XMODEM-CRC and XMODEM-1K            */
+#define XMODEM_MODE_YMODEM    1     /* YMODEM batch, single file           */
+
+/*
+** return codes of XMODEM_Poll()
+*/
+#define XMODEM_BUSY           0     /* transfer in progress                */
+#define XMODEM_DONE           1     /* transfer completed successfully     */
+#define XMODEM_ERROR          2     /* cancelled, too many retries or
+                                       sequence error                      */
+
+/** @brief  Called with every payload byte of the current block */
+typedef void (*XMODEM_DataFunc)(unsigned char data);
+
+/** @brief  Called at the end of every streamed block,
+ *          valid is 1 to commit and 0 to discard the block's bytes */
+typedef void (*XMODEM_BlockFunc)(unsigned char valid);
+
+/*
+** function prototypes
+*/
+
+/**
+   @brief   Prepare a new transfer
+   @param   mode  XMODEM_MODE_XMODEM or XMODEM_MODE_YMODEM
+   @param   data  receives the payload bytes
+   @param   block commits or discards the bytes of a block
+   @return  none
+*/
+extern void XMODEM_Init(unsigned char mode, XMODEM_DataFunc data, XMODEM_BlockFunc block);
+
+/**
+   @brief   Advance the timeout counter, call from a periodic timer interrupt
+   @param   none
+   @return  none
+*/
+extern void XMODEM_Tick(void);
+
+/**
+ *  @brief   Process received bytes and timeouts
+ *
+ *  Must be called often enough that the UART receive ringbuffer does not
+ *  overflow while a block is streaming in.
+ *
+ *  @param   none
+ *  @return  XMODEM_BUSY, XMODEM_DONE or XMODEM_ERROR
+ */
+extern unsigned char XMODEM_Poll(void);
+
+/**@}*/
+
+#endif // XMODEM_H